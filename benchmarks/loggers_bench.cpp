@@ -1,10 +1,12 @@
 #include <chlog/chlog.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <limits>
 #include <mutex>
@@ -12,6 +14,7 @@
 #include <string>
 #include <string_view>
 #include <thread>
+#include <vector>
 
 #if defined(CHLOG_HAS_SPDLOG)
   #include <spdlog/async.h>
@@ -26,6 +29,10 @@ using clock_t = std::chrono::steady_clock;
 
 struct bench_config {
   std::uint64_t iters = 1'000'000;
+  std::uint64_t sink_iters = 0;  // real-sink scenarios; 0 => iters / 10
+  unsigned max_threads = 0;      // thread sweep upper bound; 0 => max(4, hardware threads)
+  std::filesystem::path dir;     // scenario output; empty => /dev/shm when present, else the temp dir
+  bool scenarios = true;
 };
 
 std::optional<std::uint64_t> getenv_u64(const char* name) {
@@ -68,23 +75,69 @@ bench_config parse_args(int argc, char** argv) {
   if (auto it = getenv_u64("CHLOG_BENCH_ITERS")) {
     cfg.iters = *it;
   }
+  if (auto it = getenv_u64("CHLOG_BENCH_SINK_ITERS")) {
+    cfg.sink_iters = *it;
+  }
+  if (auto it = getenv_u64("CHLOG_BENCH_THREADS")) {
+    cfg.max_threads = static_cast<unsigned>(*it);
+  }
 
-  // CLI: --iters N (wins over env)
+  // CLI (wins over env):
+  //   --iters N        iterations of the counter-sink cases
+  //   --sink-iters N   calls per real-sink scenario
+  //   --threads N      largest producer count in the thread sweep
+  //   --dir PATH       where scenario files go (removed afterwards)
+  //   --no-scenarios   only run the counter-sink cases
   for (int i = 1; i < argc; ++i) {
     const std::string_view a = argv[i];
     if (a == "--iters" && (i + 1) < argc) {
       cfg.iters = static_cast<std::uint64_t>(std::strtoull(argv[i + 1], nullptr, 10));
       ++i;
+    } else if (a == "--sink-iters" && (i + 1) < argc) {
+      cfg.sink_iters = static_cast<std::uint64_t>(std::strtoull(argv[i + 1], nullptr, 10));
+      ++i;
+    } else if (a == "--threads" && (i + 1) < argc) {
+      cfg.max_threads = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+      ++i;
+    } else if (a == "--dir" && (i + 1) < argc) {
+      cfg.dir = argv[i + 1];
+      ++i;
+    } else if (a == "--no-scenarios") {
+      cfg.scenarios = false;
     }
   }
 
   if (cfg.iters == 0) {
     cfg.iters = 1;
   }
+  if (cfg.sink_iters == 0) {
+    cfg.sink_iters = std::max<std::uint64_t>(1, cfg.iters / 10);
+  }
+  if (cfg.max_threads == 0) {
+    cfg.max_threads = std::max(4u, std::thread::hardware_concurrency());
+  }
+  if (cfg.dir.empty()) {
+    std::error_code ec;
+    cfg.dir = std::filesystem::is_directory("/dev/shm", ec) ? std::filesystem::path("/dev/shm")
+                                                            : std::filesystem::temp_directory_path(ec);
+    cfg.dir /= "chlog_bench";
+  }
 
   return cfg;
 }
 
+// Percentiles in nanoseconds, taken from chlog's latency histograms (within 12.5%).
+struct latency_summary {
+  std::uint64_t p50 = 0;
+  std::uint64_t p99 = 0;
+  std::uint64_t p999 = 0;
+  std::uint64_t max = 0;
+
+  static latency_summary of(const chlog::latency_histogram& h) {
+    return {h.percentile(0.50), h.percentile(0.99), h.percentile(0.999), h.max_value};
+  }
+};
+
 struct run_result {
   std::string runner;
   std::string bench_case;
@@ -93,12 +146,27 @@ struct run_result {
   std::uint64_t processed = 0;
   std::uint64_t dropped = 0;
 
+  // Scenario cases only (group is empty for the counter-sink comparison cases).
+  std::string group;
+  unsigned threads = 1;
+  std::size_t payload = 0;
+  std::uint64_t bytes = 0;  // left on disk (rotation only keeps the newest files)
+  latency_summary call;     // producer: time inside one log call
+  latency_summary queue;    // async: event timestamp -> handed to the sink
+
   double cps() const {
     if (seconds <= 0.0) {
       return 0.0;
     }
     return static_cast<double>(calls) / seconds;
   }
+
+  double mibps() const {
+    if (seconds <= 0.0) {
+      return 0.0;
+    }
+    return static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds;
+  }
 };
 
 void print_result(const run_result& r) {
@@ -109,8 +177,23 @@ void print_result(const run_result& r) {
             << " seconds=" << r.seconds
             << " cps=" << r.cps()
             << " processed=" << r.processed
-            << " dropped=" << r.dropped
-            << "\n";
+            << " dropped=" << r.dropped;
+  if (!r.group.empty()) {
+    std::cout << " group=" << r.group
+              << " threads=" << r.threads
+              << " payload=" << r.payload
+              << " bytes=" << r.bytes
+              << " mibps=" << r.mibps()
+              << " call_p50_ns=" << r.call.p50
+              << " call_p99_ns=" << r.call.p99
+              << " call_p999_ns=" << r.call.p999
+              << " call_max_ns=" << r.call.max
+              << " queue_p50_ns=" << r.queue.p50
+              << " queue_p99_ns=" << r.queue.p99
+              << " queue_p999_ns=" << r.queue.p999
+              << " queue_max_ns=" << r.queue.max;
+  }
+  std::cout << "\n";
 }
 
 std::uint64_t next_pow2_u64(std::uint64_t v) {
@@ -207,7 +290,43 @@ run_result bench_chlog_filtered_out(std::uint64_t iters) {
   return r;
 }
 
-run_result bench_chlog_async_mt(std::uint64_t iters) {
+// Compile-time filtering: the bench target is built with CHLOG_ACTIVE_LEVEL=CHLOG_LEVEL_DEBUG,
+// so CHLOG_TRACE expands to nothing even though the runtime level would accept it.
+run_result bench_chlog_filtered_out_static(std::uint64_t iters) {
+  std::atomic<std::uint64_t> processed{0};
+
+  chlog::logger_config cfg;
+  cfg.name = "chlog_filtered_out_static";
+  cfg.level = chlog::level::trace;
+  cfg.single_threaded = true;
+  cfg.async.enabled = false;
+  cfg.parallel_sinks = false;
+  cfg.pattern = "{msg}";
+
+  auto lg = std::make_shared<chlog::logger>(cfg);
+  lg->add_sink(std::make_shared<chlog_counter_sink>(processed));
+
+  const auto t0 = clock_t::now();
+  for (std::uint64_t i = 0; i < iters; ++i) {
+    CHLOG_TRACE(*lg, "v {}", i);
+  }
+  const auto t1 = clock_t::now();
+
+  run_result r;
+  r.runner = "chlog";
+  r.bench_case = "filtered_out_static";
+  r.calls = iters;
+  r.seconds = std::chrono::duration<double>(t1 - t0).count();
+  r.processed = processed.load(std::memory_order_relaxed);
+  r.dropped = 0;
+
+  lg->shutdown();
+  return r;
+}
+
+run_result bench_chlog_async_mt(std::uint64_t iters,
+                                chlog::logger_config::async_cfg::queue_backend backend,
+                                const char* bench_case) {
   std::atomic<std::uint64_t> processed{0};
 
   chlog::logger_config cfg;
@@ -215,12 +334,14 @@ run_result bench_chlog_async_mt(std::uint64_t iters) {
   cfg.level = chlog::level::info;
   cfg.single_threaded = false;
   cfg.async.enabled = true;
+  cfg.async.backend = backend;
   {
     auto cap = next_pow2_u64(iters);
     if (cap > static_cast<std::uint64_t>(std::numeric_limits<std::uint32_t>::max())) {
       cap = static_cast<std::uint64_t>(std::numeric_limits<std::uint32_t>::max());
     }
     cfg.async.queue_capacity = static_cast<std::uint32_t>(cap);
+    cfg.async.per_thread_capacity = static_cast<std::uint32_t>(cap);
   }
   cfg.async.batch_max = 256;
   cfg.async.flush_every = std::chrono::milliseconds(0);
@@ -244,16 +365,217 @@ run_result bench_chlog_async_mt(std::uint64_t iters) {
 
   run_result r;
   r.runner = "chlog";
-  r.bench_case = "async_mt";
+  r.bench_case = bench_case;
   r.calls = iters;
   r.seconds = std::chrono::duration<double>(t1 - t0).count();
   r.processed = processed.load(std::memory_order_relaxed);
-  r.dropped = 0;
+  r.dropped = lg->stats().dropped;
+
+  lg->shutdown();
+  return r;
+}
+
+
+// -------------------- chlog scenarios (real sinks) --------------------
+//
+// These write through the library's own file sinks into cfg.dir (tmpfs by default, so the
+// numbers reflect the logging pipeline rather than the disk) with latency_histograms on, and
+// report per-call and enqueue-to-sink percentiles next to the throughput. The clock stops once
+// shutdown() has drained the queue and flushed the sinks.
+
+enum class sink_kind { file, json, rotating };
+
+struct scenario {
+  std::string bench_case;
+  std::string group;
+  sink_kind kind = sink_kind::file;
+  unsigned threads = 1;
+  std::size_t payload = 64;
+  std::uint64_t calls = 0;  // total across all producer threads
+  bool async = true;
+  std::uint32_t queue_capacity = 1u << 16;
+  bool drop_when_full = false;
+  std::size_t file_buffer = 64 * 1024;   // file_writer_options::buffer_size
+  std::size_t rotate_bytes = 0;          // sink_kind::rotating
+  std::size_t rotate_files = 4;
+};
+
+std::uint64_t dir_bytes(const std::filesystem::path& dir) {
+  std::uint64_t total = 0;
+  std::error_code ec;
+  for (const auto& e : std::filesystem::recursive_directory_iterator(dir, ec)) {
+    if (e.is_regular_file(ec)) {
+      total += static_cast<std::uint64_t>(e.file_size(ec));
+    }
+  }
+  return total;
+}
+
+run_result bench_chlog_scenario(const scenario& sc, const std::filesystem::path& root) {
+  const auto dir = root / sc.bench_case;
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  std::filesystem::create_directories(dir);
 
+  chlog::logger_config cfg;
+  cfg.name = "chlog_" + sc.bench_case;
+  cfg.level = chlog::level::info;
+  cfg.single_threaded = !sc.async && sc.threads == 1;
+  cfg.async.enabled = sc.async;
+  cfg.async.queue_capacity = sc.queue_capacity;
+  cfg.async.per_thread_capacity = sc.queue_capacity;
+  cfg.async.drop_when_full = sc.drop_when_full;
+  cfg.async.batch_max = 256;
+  cfg.async.flush_every = std::chrono::milliseconds(0);
+  cfg.parallel_sinks = false;
+  cfg.latency_histograms = true;
+
+  chlog::file_writer_options fo;
+  fo.buffer_size = sc.file_buffer;
+
+  std::shared_ptr<chlog::sink> sink;
+  switch (sc.kind) {
+    case sink_kind::file:
+      sink = std::make_shared<chlog::rotating_file_sink>(dir / "bench.log", std::numeric_limits<std::size_t>::max(), 1, fo);
+      break;
+    case sink_kind::json:
+      sink = std::make_shared<chlog::json_sink>(dir / "bench.jsonl", fo);
+      break;
+    case sink_kind::rotating:
+      sink = std::make_shared<chlog::rotating_file_sink>(dir / "bench.log", sc.rotate_bytes, sc.rotate_files, fo);
+      break;
+  }
+
+  auto lg = std::make_shared<chlog::logger>(cfg);
+  lg->add_sink(sink);
+
+  const std::string payload(sc.payload, 'x');
+  const std::uint64_t per_thread = std::max<std::uint64_t>(1, sc.calls / sc.threads);
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> go{false};
+
+  auto produce = [&](unsigned t) {
+    ready.fetch_add(1, std::memory_order_relaxed);
+    while (!go.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    const std::string_view p = payload;
+    for (std::uint64_t i = 0; i < per_thread; ++i) {
+      lg->info("t{} {} {}", t, i, p);
+    }
+  };
+
+  std::vector<std::thread> producers;
+  producers.reserve(sc.threads);
+  for (unsigned t = 0; t < sc.threads; ++t) {
+    producers.emplace_back(produce, t);
+  }
+  while (ready.load(std::memory_order_relaxed) < sc.threads) {
+    std::this_thread::yield();
+  }
+
+  const auto t0 = clock_t::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : producers) {
+    th.join();
+  }
   lg->shutdown();
+  const auto t1 = clock_t::now();
+
+  const auto st = lg->stats();
+
+  run_result r;
+  r.runner = "chlog";
+  r.bench_case = sc.bench_case;
+  r.calls = per_thread * sc.threads;
+  r.seconds = std::chrono::duration<double>(t1 - t0).count();
+  r.processed = st.dequeued;
+  r.dropped = st.dropped;
+  r.group = sc.group;
+  r.threads = sc.threads;
+  r.payload = sc.payload;
+  r.call = latency_summary::of(st.call_ns);
+  r.queue = latency_summary::of(st.queue_ns);
+
+  lg.reset();
+  sink.reset();  // joins the rotation worker before the files are counted
+  r.bytes = dir_bytes(dir);
+  std::filesystem::remove_all(dir, ec);
   return r;
 }
 
+std::vector<scenario> chlog_scenarios(const bench_config& cfg) {
+  std::vector<scenario> out;
+  const std::uint64_t n = cfg.sink_iters;
+
+  // Producer threads 1, 2, 4, ... max_threads.
+  for (unsigned t = 1;; t = std::min(t * 2, cfg.max_threads)) {
+    scenario sc;
+    sc.bench_case = "threads_" + std::to_string(t);
+    sc.group = "threads";
+    sc.threads = t;
+    sc.calls = n;
+    out.push_back(sc);
+    if (t == cfg.max_threads) {
+      break;
+    }
+  }
+
+  // Payload 8 B .. 4 KiB through the plain and the JSON file sink; large payloads are capped at
+  // 64 MiB per case so tmpfs does not fill up.
+  for (const sink_kind kind : {sink_kind::file, sink_kind::json}) {
+    for (const std::size_t payload : {8u, 64u, 512u, 4096u}) {
+      scenario sc;
+      sc.kind = kind;
+      sc.bench_case = std::string(kind == sink_kind::json ? "json_" : "file_") + std::to_string(payload) + "b";
+      sc.group = "payload";
+      sc.payload = payload;
+      sc.calls = std::min<std::uint64_t>(n, (64u << 20) / payload);
+      out.push_back(sc);
+    }
+  }
+
+  // Synchronous write in the caller, for comparison with file_64b.
+  {
+    scenario sc;
+    sc.bench_case = "sync_file_64b";
+    sc.group = "payload";
+    sc.async = false;
+    sc.calls = n;
+    out.push_back(sc);
+  }
+
+  const unsigned busy = std::min(4u, cfg.max_threads);
+
+  // Size rotation every 1 MiB while several producers keep logging.
+  {
+    scenario sc;
+    sc.bench_case = "rotate_under_load";
+    sc.group = "rotation";
+    sc.kind = sink_kind::rotating;
+    sc.threads = busy;
+    sc.payload = 256;
+    sc.calls = n;
+    sc.rotate_bytes = 1u << 20;
+    out.push_back(sc);
+  }
+
+  // A 1024-slot queue in front of an unbuffered file (one write per line), so producers outrun
+  // the worker: drop_when_full shows the loss rate, blocking shows the producer stalls.
+  for (const bool drop : {true, false}) {
+    scenario sc;
+    sc.bench_case = drop ? "queue_full_drop" : "queue_full_block";
+    sc.group = "queue_full";
+    sc.threads = busy;
+    sc.calls = n;
+    sc.queue_capacity = 1024;
+    sc.drop_when_full = drop;
+    sc.file_buffer = 0;
+    out.push_back(sc);
+  }
+
+  return out;
+}
 
 #if defined(CHLOG_HAS_SPDLOG)
 // -------------------- spdlog sinks --------------------
@@ -331,6 +653,32 @@ run_result bench_spdlog_filtered_out(std::uint64_t iters) {
   return r;
 }
 
+// Built with SPDLOG_ACTIVE_LEVEL=SPDLOG_LEVEL_DEBUG (see benchmarks/CMakeLists.txt).
+run_result bench_spdlog_filtered_out_static(std::uint64_t iters) {
+  std::atomic<std::uint64_t> processed{0};
+
+  auto sink = std::make_shared<spdlog_counter_sink<spdlog::details::null_mutex>>(processed);
+  auto lg = std::make_shared<spdlog::logger>("spdlog_filtered_out_static", spdlog::sinks_init_list{sink});
+
+  lg->set_level(spdlog::level::trace);
+
+  const auto t0 = clock_t::now();
+  for (std::uint64_t i = 0; i < iters; ++i) {
+    SPDLOG_LOGGER_TRACE(lg, "v {}", i);
+  }
+  const auto t1 = clock_t::now();
+
+  run_result r;
+  r.runner = "spdlog";
+  r.bench_case = "filtered_out_static";
+  r.calls = iters;
+  r.seconds = std::chrono::duration<double>(t1 - t0).count();
+  r.processed = processed.load(std::memory_order_relaxed);
+  r.dropped = 0;
+
+  return r;
+}
+
 run_result bench_spdlog_async_mt(std::uint64_t iters) {
   std::atomic<std::uint64_t> processed{0};
 
@@ -385,13 +733,24 @@ int main(int argc, char** argv) {
 
   // chlog
   print_result(bench_chlog_filtered_out(cfg.iters));
+  print_result(bench_chlog_filtered_out_static(cfg.iters));
   print_result(bench_chlog_sync(true, cfg.iters));
   print_result(bench_chlog_sync(false, cfg.iters));
-  print_result(bench_chlog_async_mt(cfg.iters));
+  print_result(bench_chlog_async_mt(cfg.iters, chlog::logger_config::async_cfg::queue_backend::ring, "async_mt"));
+  print_result(bench_chlog_async_mt(cfg.iters, chlog::logger_config::async_cfg::queue_backend::byte_ring, "async_mt_byte_ring"));
+  print_result(bench_chlog_async_mt(cfg.iters, chlog::logger_config::async_cfg::queue_backend::per_thread, "async_mt_per_thread"));
+  if (cfg.scenarios) {
+    for (const auto& sc : chlog_scenarios(cfg)) {
+      print_result(bench_chlog_scenario(sc, cfg.dir));
+    }
+    std::error_code ec;
+    std::filesystem::remove(cfg.dir, ec);
+  }
 
 #if defined(CHLOG_HAS_SPDLOG)
   // spdlog
   print_result(bench_spdlog_filtered_out(cfg.iters));
+  print_result(bench_spdlog_filtered_out_static(cfg.iters));
   print_result(bench_spdlog_sync(true, cfg.iters));
   print_result(bench_spdlog_sync(false, cfg.iters));
   print_result(bench_spdlog_async_mt(cfg.iters));
@@ -3,65 +3,303 @@
 // chlog: header-only logging library
 // C++20 required (std::format, std::source_location)
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
+#include <cerrno>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <deque>
 #include <filesystem>
 #include <format>
-#include <fstream>
-#include <functional>
-#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <new>
 #include <mutex>
 #include <optional>
-#include <queue>
 #include <semaphore>
+#include <set>
 #include <shared_mutex>
+#include <span>
 #include <source_location>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <intrin.h>
+    #include <io.h>
+    #include <process.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #if defined(__linux__)
+        #include <linux/futex.h>
+        #include <pthread.h>
+        #include <sched.h>
+        #include <sys/syscall.h>
+    #endif
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+// Network sinks (syslog_sink, http_sink): POSIX sockets. Define CHLOG_NO_NET_SINKS to leave them out.
+#if !defined(_WIN32) && !defined(CHLOG_NO_NET_SINKS)
+    #define CHLOG_NET_SINKS 1
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+#endif
+
 #if defined(CHLOG_USE_FMT)
     #include <fmt/format.h>
 #endif
 
+// Optional gzip compression of rotated files (rotation_options::compression::gzip); link zlib.
+#if defined(CHLOG_USE_ZLIB)
+    #include <cstdio>
+    #include <zlib.h>
+#endif
+
+// Optional io_uring submission of file writes (file_writer_options::io_uring); Linux 5.6+. Uses
+// the raw syscalls, so no liburing is needed.
+#if defined(CHLOG_USE_IO_URING) && defined(__linux__)
+    #define CHLOG_IO_URING 1
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+#endif
+
+// SIMD fast paths (JSON escaping). Define CHLOG_NO_SIMD to force the portable code.
+#if !defined(CHLOG_NO_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define CHLOG_SIMD_SSE2 1
+        #include <immintrin.h>
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #define CHLOG_SIMD_NEON 1
+        #include <arm_neon.h>
+    #endif
+#endif
+
+// Compile-time level threshold. Define CHLOG_ACTIVE_LEVEL (e.g. -DCHLOG_ACTIVE_LEVEL=CHLOG_LEVEL_INFO)
+// to remove lower-level CHLOG_* macro calls entirely (arguments are not evaluated) and to turn
+// the matching logger::trace()/debug()/... calls into no-ops.
+#define CHLOG_LEVEL_TRACE 0
+#define CHLOG_LEVEL_DEBUG 1
+#define CHLOG_LEVEL_INFO 2
+#define CHLOG_LEVEL_WARN 3
+#define CHLOG_LEVEL_ERROR 4
+#define CHLOG_LEVEL_CRITICAL 5
+#define CHLOG_LEVEL_OFF 6
+
+#ifndef CHLOG_ACTIVE_LEVEL
+    #define CHLOG_ACTIVE_LEVEL CHLOG_LEVEL_TRACE
+#endif
+
 namespace chlog {
 
 namespace detail {
 
 template <class... Args>
-inline std::string format_payload(std::format_string<Args...> fmt, Args&&... args) {
+inline void vformat_payload_to(std::string& out, std::string_view fmt, Args&&... args) {
 #if defined(CHLOG_USE_FMT)
-    // Use fmt for speed; std::format_string still provides compile-time checking.
-    return fmt::format(fmt::runtime(fmt.get()), std::forward<Args>(args)...);
+    fmt::vformat_to(std::back_inserter(out), fmt::string_view(fmt.data(), fmt.size()), fmt::make_format_args(std::forward<Args>(args)...));
 #else
-    return std::format(fmt, std::forward<Args>(args)...);
+    std::vformat_to(std::back_inserter(out), fmt, std::make_format_args(std::forward<Args>(args)...));
 #endif
 }
 
-template <class... Args>
-inline std::string vformat_payload(std::string_view fmt, Args&&... args) {
+// Per-thread formatting scratch. It keeps its capacity between calls (up to scratch_keep), so
+// formatting a message allocates only when a line is longer than anything seen so far.
+inline constexpr std::size_t scratch_keep = 64 * 1024;
+
+inline std::string& format_scratch() noexcept {
+    thread_local std::string buf;
+    return buf;
+}
+
+template <class Out>
+inline void take_scratch(Out& out, std::string& buf) {
+    out.assign(buf.data(), buf.size());
+    if (buf.capacity() > scratch_keep) std::string().swap(buf);
+}
+
+// Formats into the thread's scratch buffer, then copies the text into `out` (a payload_buffer,
+// so short messages end up in the event's inline storage without touching the heap).
+template <class Out, class... Args>
+inline void format_payload_to(Out& out, std::format_string<Args...> fmt, Args&&... args) {
+    std::string& buf = format_scratch();
+    buf.clear();
 #if defined(CHLOG_USE_FMT)
-    return fmt::vformat(fmt::string_view(fmt.data(), fmt.size()), fmt::make_format_args(std::forward<Args>(args)...));
+    // Use fmt for speed; std::format_string still provides compile-time checking.
+    fmt::format_to(std::back_inserter(buf), fmt::runtime(fmt.get()), std::forward<Args>(args)...);
 #else
-    return std::vformat(fmt, std::make_format_args(std::forward<Args>(args)...));
+    std::format_to(std::back_inserter(buf), fmt, std::forward<Args>(args)...);
 #endif
+    take_scratch(out, buf);
+}
+
+template <class Out, class... Args>
+inline void vformat_payload_into(Out& out, std::string_view fmt, Args&&... args) {
+    std::string& buf = format_scratch();
+    buf.clear();
+    vformat_payload_to(buf, fmt, std::forward<Args>(args)...);
+    take_scratch(out, buf);
+}
+
+// =========================== Deferred Formatting ===========================
+// With async.deferred_format, producers do not run std::format. Arguments are encoded into
+// a compact byte record (stored in log_event::payload) and the async worker formats them.
+//
+// Encoding:
+// - arithmetic / enum / void* / nullptr_t: raw bytes (memcpy)
+// - string-like (std::string, std::string_view, const char*, char arrays): size + bytes (copied inline)
+// Any other argument type makes the call non-deferrable; it is formatted eagerly instead.
+
+template <class T>
+inline constexpr bool is_string_arg_v = std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> ||
+                                        std::is_same_v<T, const char*> || std::is_same_v<T, char*>;
+
+template <class T>
+inline constexpr bool is_raw_arg_v = std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, const void*> ||
+                                     std::is_same_v<T, void*> || std::is_same_v<T, std::nullptr_t>;
+
+template <class... Args>
+inline constexpr bool is_deferrable_v = ((is_string_arg_v<std::decay_t<Args>> || is_raw_arg_v<std::decay_t<Args>>) && ...);
+
+template <class T>
+using deferred_arg_t = std::conditional_t<is_string_arg_v<std::decay_t<T>>, std::string_view, std::decay_t<T>>;
+
+inline std::string_view as_string_arg(std::string_view s) noexcept { return s; }
+inline std::string_view as_string_arg(const char* s) noexcept { return s ? std::string_view(s) : std::string_view{}; }
+
+template <class T>
+inline std::size_t encoded_size(const T& v) noexcept {
+    if constexpr (is_string_arg_v<std::decay_t<T>>) {
+        return sizeof(std::size_t) + as_string_arg(v).size();
+    } else {
+        return sizeof(std::decay_t<T>);
+    }
+}
+
+template <class T>
+inline void encode_arg(char*& p, const T& v) noexcept {
+    if constexpr (is_string_arg_v<std::decay_t<T>>) {
+        const auto sv = as_string_arg(v);
+        const std::size_t n = sv.size();
+        std::memcpy(p, &n, sizeof(n));
+        p += sizeof(n);
+        if (n) std::memcpy(p, sv.data(), n);
+        p += n;
+    } else {
+        const std::decay_t<T> tmp = v;
+        std::memcpy(p, &tmp, sizeof(tmp));
+        p += sizeof(tmp);
+    }
+}
+
+template <class T>
+inline deferred_arg_t<T> decode_arg(const char*& p) noexcept {
+    if constexpr (is_string_arg_v<std::decay_t<T>>) {
+        std::size_t n = 0;
+        std::memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        const std::string_view sv(p, n);
+        p += n;
+        return sv;
+    } else {
+        std::decay_t<T> v;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
 }
 
+template <class Out, class... Args>
+inline void encode_args(Out& out, const Args&... args) {
+    out.resize((std::size_t{0} + ... + encoded_size(args)));
+    char* p = out.data();
+    (encode_arg(p, args), ...);
+    (void)p;
+}
+
+// Appends the formatted text for an encoded record produced by encode_args<Args...>.
+template <class... Args>
+inline void format_deferred(std::string& out, std::string_view fmt, const char* data) {
+    const char* p = data;
+    // Braced init guarantees left-to-right decoding.
+    std::tuple<deferred_arg_t<Args>...> decoded{decode_arg<Args>(p)...};
+    (void)p;
+    std::apply([&](auto&... a) { vformat_payload_to(out, fmt, a...); }, decoded);
+}
+
+// One-character type tag per encoded argument (Python `struct` codes, plus 's' for strings and
+// 'n' for nullptr), so encoded records can be decoded outside the process (binary_file_sink).
+template <class T>
+constexpr char arg_tag() noexcept {
+    using U = std::decay_t<T>;
+    if constexpr (is_string_arg_v<U>) return 's';
+    else if constexpr (std::is_enum_v<U>) return arg_tag<std::underlying_type_t<U>>();
+    else if constexpr (std::is_same_v<U, bool>) return '?';
+    else if constexpr (std::is_same_v<U, char>) return 'c';
+    else if constexpr (std::is_integral_v<U>) {
+        constexpr bool s = std::is_signed_v<U>;
+        if constexpr (sizeof(U) == 1) return s ? 'b' : 'B';
+        else if constexpr (sizeof(U) == 2) return s ? 'h' : 'H';
+        else if constexpr (sizeof(U) == 4) return s ? 'i' : 'I';
+        else return s ? 'q' : 'Q';
+    } else if constexpr (std::is_same_v<U, float>) return 'f';
+    else if constexpr (std::is_same_v<U, double>) return 'd';
+    else if constexpr (std::is_same_v<U, long double>) return 'g';
+    else if constexpr (std::is_same_v<U, std::nullptr_t>) return 'n';
+    else return 'P';
+}
+
+// Static description of one deferred argument list: how to format it and how it is encoded.
+struct deferred_codec {
+    void (*format)(std::string& out, std::string_view fmt, const char* data);
+    std::string_view types; // arg_tag() of each argument, in order
+};
+
+template <class... Args>
+inline constexpr char deferred_types[] = {arg_tag<Args>()..., '\0'};
+
+template <class... Args>
+inline constexpr deferred_codec deferred_codec_for{&format_deferred<Args...>,
+                                                   std::string_view(deferred_types<Args...>, sizeof...(Args))};
+
 }  // namespace detail
 
 // =========================== Levels & Config ===========================
 
 enum class level : int { trace, debug, info, warn, error, critical, off };
+inline constexpr std::size_t level_count = static_cast<std::size_t>(level::off); // loggable levels
+
+static_assert(static_cast<int>(level::trace) == CHLOG_LEVEL_TRACE && static_cast<int>(level::off) == CHLOG_LEVEL_OFF);
+
+// True if `lv` survives the compile-time CHLOG_ACTIVE_LEVEL threshold.
+inline constexpr bool level_active(level lv) noexcept { return static_cast<int>(lv) >= CHLOG_ACTIVE_LEVEL; }
 
 inline constexpr std::string_view level_name(level lv) noexcept {
     switch (lv) {
@@ -89,6 +327,8 @@ inline constexpr int level_weight(level lv) noexcept {
     return 0;
 }
 
+class async_backend;
+
 struct logger_config {
     std::string name = "default";
     chlog::level level = chlog::level::info;
@@ -99,7 +339,7 @@ struct logger_config {
     // - Forces async + parallel_sinks off to avoid background threads and cross-thread sink writes.
     bool single_threaded = false;
 
-    // Pattern tokens: {ts} {date} {time} {ms} {lvl} {tid} {name} {msg} {file} {line} {func}
+    // Pattern tokens: {ts} {date} {time} {ms} {us} {ns} {lvl} {tid} {name} {msg} {file} {line} {func}
     // Special pattern: {json} outputs a structured JSON line.
     std::string pattern = "[{date} {time}.{ms}][{lvl}][tid={tid}][{name}] {msg}";
 
@@ -113,6 +353,22 @@ struct logger_config {
 
     chlog::level flush_on_level = chlog::level::error;
 
+    // Per-call-site rate limiting, applied before the event is built or formatted. Each site
+    // (a CHLOG_* expansion or a log_at() source location) may log `burst` events per `period`;
+    // past that, only every sample_one_in-th event gets through (0 => none). Suppressed events
+    // are reported as "suppressed N messages from this call site" at the same level: by the
+    // site's first call after the window ends, by the async worker's timed flush once the window
+    // is over (the logger's next timed flush with a shared backend), and by flush()/shutdown().
+    // Only levels below `below` are limited. Plain lg.info(...) calls carry no per-site
+    // identity and are not limited. Limiter state lives in the call site, so it is shared
+    // by every logger that site logs to.
+    struct rate_limit_cfg {
+        std::size_t burst = 0; // 0 and sample_one_in <= 1 => off
+        std::chrono::milliseconds period{1000};
+        std::size_t sample_one_in = 0;
+        chlog::level below = chlog::level::warn;
+    } rate_limit;
+
     struct async_cfg {
         bool enabled = false;
         std::size_t queue_capacity = 1u << 14; // 16384
@@ -124,708 +380,5335 @@ struct logger_config {
         // - false: block producers
         bool drop_when_full = true;
 
-        // Kept for compatibility with the original project; now maps to a faster
-        // two-tier priority queue implementation.
+        // Priority lanes (ring / byte_ring backends). false => one FIFO ring of the whole capacity.
         bool weighted_queue = true;
+
+        // Each lane is its own ring and takes the levels from min_level up to the next higher
+        // lane's min_level (levels below the lowest lane go to the lowest lane).
+        // - capacity: events (ring) or bytes (byte_ring); 0 => an equal share of whatever the
+        //   explicitly sized lanes leave of queue_capacity / queue_bytes
+        // - weight: share of each batch under lane_schedule::weighted (0 => level_weight(min_level))
+        // - deadline: lane_schedule::deadline serves the lane first once it has gone this long
+        //   without being polled (0 => no deadline)
+        // Empty => two lanes: warn+ (1/4 of the capacity) and everything else.
+        struct lane {
+            chlog::level min_level = chlog::level::trace;
+            std::size_t capacity = 0;
+            std::size_t weight = 0;
+            std::chrono::milliseconds deadline{0};
+        };
+        std::vector<lane> lanes;
+
+        // How the worker fills a batch from the lanes:
+        // - strict: highest lane first; lower lanes get what is left of batch_max
+        // - weighted: weighted round-robin; each lane gets at least its share of batch_max, so a
+        //   burst in one lane can't starve the others
+        // - deadline: strict, except overdue lanes (see lane::deadline) are drained first
+        enum class lane_schedule { strict, weighted, deadline };
+        lane_schedule schedule = lane_schedule::strict;
+
+        // Deferred formatting: producers enqueue the (compile-time checked) format string plus
+        // the encoded arguments, and the worker thread runs the actual formatting.
+        // Only arithmetic/enum/pointer and string-like arguments are deferred; calls with other
+        // argument types, or with runtime format strings, are formatted on the producer as usual.
+        bool deferred_format = false;
+
+        // Queue implementation:
+        // - ring: fixed log_event cells (one moved log_event per slot)
+        // - byte_ring: variable-length records serialized in place; the worker decodes into
+        //   reusable events. Sized by queue_bytes (0 => queue_capacity * sizeof(log_event)).
+        // - per_thread: one wait-free SPSC ring pair per producer thread (per_thread_capacity
+        //   events each), merged by the worker according to per_thread_merge.
+        enum class queue_backend { ring, byte_ring, per_thread };
+        queue_backend backend = queue_backend::ring;
+        std::size_t queue_bytes = 0;
+
+        enum class merge_order { none, seq, timestamp };
+        std::size_t per_thread_capacity = 1u << 12; // 4096
+        merge_order per_thread_merge = merge_order::none;
+
+        // What the worker does when the queue is empty:
+        // - park: block on the queue's semaphore right away (no idle CPU)
+        // - spin_park: poll up to spin_count times, then park
+        // - spin_yield: poll up to spin_count times, then keep polling with yield()
+        // - busy_spin: poll continuously (lowest enqueue-to-sink latency; occupies a core)
+        // Parking sleeps until the next flush_every deadline (or until woken by a producer).
+        enum class wait_strategy { park, spin_park, spin_yield, busy_spin };
+        wait_strategy wait = wait_strategy::park;
+        std::uint32_t spin_count = 1u << 12;
+        int worker_cpu = -1; // >= 0: pin the worker thread to this CPU (Linux; ignored elsewhere)
+
+        // Sink workers: the worker hands every batch to one consumer thread per sink (or per sink
+        // group, see logger::add_sink), each with its own queue of sink_queue_capacity events, so
+        // a slow sink only holds up its own output. When a sink queue is full:
+        // - sink_drop_when_full = true: that sink loses the batch (see metrics_snapshot::sink_queues)
+        // - false: the worker waits, and the backpressure reaches producers through the main queue
+        bool sink_workers = false;
+        std::size_t sink_queue_capacity = 1u << 14; // 16384
+        bool sink_drop_when_full = true;
+
+        // Shared backend: the logger submits into this backend's queues and is served by its
+        // worker threads instead of owning a queue and a thread (implies enabled). Queue sizing,
+        // lanes, backend, batching, flush_every and the wait strategy then come from the
+        // backend's own async_cfg; drop_when_full, deferred_format and sink_workers still apply
+        // per logger. Ignored (and released) by single_threaded loggers, which never go async.
+        std::shared_ptr<async_backend> shared_backend;
     } async;
 
     bool parallel_sinks = true;
     std::size_t sink_pool_size = 0; // 0 => = sinks.size()
-};
-
-// =========================== Events & Metrics ===========================
-
-struct log_event {
-    std::chrono::system_clock::time_point ts;
-    level lvl{};
-    std::thread::id tid{};
-    std::string name;
-    std::string payload;
-    std::uint64_t seq{};
-
-    std::source_location loc{};
-};
 
-struct metrics_snapshot {
-    std::size_t dropped{};
-    std::size_t enqueued{};
-    std::size_t dequeued{};
-    std::size_t flushed{};
-    std::size_t queue_size{};
-};
-
-struct metrics {
-    std::atomic<std::size_t> dropped{0};
-    std::atomic<std::size_t> enqueued{0};
-    std::atomic<std::size_t> dequeued{0};
-    std::atomic<std::size_t> flushed{0};
-    std::atomic<std::size_t> queue_size{0};
+    // Record call latency, enqueue-to-sink latency, batch sizes and per-sink write times into
+    // per-thread histograms (see metrics_snapshot). Costs two clock reads per call; in async mode
+    // it also forces capture_timestamp on, since queue latency is measured from the event time.
+    bool latency_histograms = false;
 };
 
-// =========================== Time / Formatting Utils ===========================
-
-inline std::tm localtime_safe(std::time_t t) noexcept {
-    std::tm tm{};
-#ifdef _WIN32
-    ::localtime_s(&tm, &t);
-#else
-    ::localtime_r(&t, &tm);
-#endif
-    return tm;
-}
-
-inline std::string make_timestamp(std::chrono::system_clock::time_point tp) {
-    const auto tt = std::chrono::system_clock::to_time_t(tp);
-    const auto tm = localtime_safe(tt);
-    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count() % 1000;
-    std::ostringstream ts;
-    ts << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << '.' << std::setw(3) << std::setfill('0') << ms;
-    return ts.str();
-}
+// =========================== Events & Metrics ===========================
 
-inline std::string date_string(std::chrono::system_clock::time_point tp) {
-    const auto tt = std::chrono::system_clock::to_time_t(tp);
-    const auto tm = localtime_safe(tt);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%d");
-    return oss.str();
-}
+namespace detail {
 
-inline std::string time_string(std::chrono::system_clock::time_point tp) {
-    const auto tt = std::chrono::system_clock::to_time_t(tp);
-    const auto tm = localtime_safe(tt);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%H:%M:%S");
-    return oss.str();
-}
+// Per-call-site rate limiter (logger_config::rate_limit): a token bucket refilled in full once
+// per period, i.e. at most `burst` events per window. The first window opens with the site's
+// first call. Under the limit the cost is one relaxed fetch_add on the site; otherwise the clock
+// is only read on that first call and once a window's budget is used up.
+struct site_limiter {
+    struct verdict {
+        bool pass = true;
+        std::uint64_t suppressed = 0; // > 0: a window closed with this many events suppressed
+        bool first_suppressed = false; // the site has nothing unreported before this event
+    };
 
-inline std::string thread_id_string(std::thread::id tid) {
-    std::ostringstream oss;
-    oss << tid;
-    return oss.str();
-}
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::int64_t> window_end{0}; // steady_clock ns; 0 => no window yet
+    std::atomic<std::uint64_t> suppressed{0};
+
+    verdict admit(std::uint64_t burst, std::chrono::nanoseconds period, std::uint64_t sample_one_in) noexcept {
+        const std::uint64_t n = count.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (n <= burst) {
+            // Only the very first call sees n == 1 (a new window resets count to 1, not 0).
+            std::int64_t none = 0;
+            if (n == 1 && window_end.load(std::memory_order_relaxed) == 0)
+                window_end.compare_exchange_strong(none, clock_ns() + period.count(), std::memory_order_relaxed);
+            return {};
+        }
 
-inline std::string json_escape(std::string_view s) {
-    std::string out;
-    out.reserve(s.size() + 16);
-    for (const char c : s) {
-        switch (c) {
-            case '"': out += "\\\""; break;
-            case '\\': out += "\\\\"; break;
-            case '\b': out += "\\b"; break;
-            case '\f': out += "\\f"; break;
-            case '\n': out += "\\n"; break;
-            case '\r': out += "\\r"; break;
-            case '\t': out += "\\t"; break;
-            default:
-                if (static_cast<unsigned char>(c) < 0x20) {
-                    out += std::format("\\u{:04X}", static_cast<unsigned int>(static_cast<unsigned char>(c)));
-                } else {
-                    out.push_back(c);
-                }
+        const std::int64_t now = clock_ns();
+        std::int64_t end = window_end.load(std::memory_order_relaxed);
+        if (now >= end) {
+            // Budget exhausted but the window is over: open a new one (one thread wins).
+            if (window_end.compare_exchange_strong(end, now + period.count(), std::memory_order_relaxed)) {
+                count.store(1, std::memory_order_relaxed);
+                return {true, suppressed.exchange(0, std::memory_order_relaxed)};
+            }
+            return {};
         }
+        if (sample_one_in > 1 && (n - burst) % sample_one_in == 0) return {};
+        const bool first = suppressed.fetch_add(1, std::memory_order_relaxed) == 0;
+        return {false, 0, first};
     }
-    return out;
-}
-
-// =========================== Sink Interface ===========================
-
-class sink {
-public:
-    virtual ~sink() = default;
-    virtual void set_pattern(std::string pat) { pattern_ = std::move(pat); }
-    virtual void set_level(level lv) { level_ = lv; }
-    virtual void set_thread_safe(bool enabled) noexcept { thread_safe_ = enabled; }
-    virtual level level_threshold() const { return level_; }
-    virtual void log(const log_event& e) = 0;
-    virtual void flush() {}
-
-protected:
-    std::string pattern_ = "[{date} {time}.{ms}][{lvl}][{name}] {msg}";
-    level level_ = level::trace;
-    bool thread_safe_ = true;
 
-    std::string render(const log_event& e) const {
-        if (pattern_ == "{json}") {
-            return std::format(
-                R"({{"ts":"{}","lvl":"{}","tid":"{}","name":"{}","seq":{},"file":"{}","line":{},"func":"{}","msg":"{}"}})",
-                make_timestamp(e.ts),
-                level_name(e.lvl),
-                thread_id_string(e.tid),
-                e.name,
-                e.seq,
-                json_escape(e.loc.file_name()),
-                e.loc.line(),
-                json_escape(e.loc.function_name()),
-                json_escape(e.payload));
-        }
-
-        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(e.ts.time_since_epoch()).count() % 1000;
-
-        std::string out = pattern_;
-        auto replace_all = [&](std::string& s, std::string_view key, std::string_view val) {
-            std::size_t pos = 0;
-            while ((pos = s.find(key, pos)) != std::string::npos) {
-                s.replace(pos, key.size(), val);
-                pos += val.size();
-            }
-        };
+    // Unreported suppressed events, reset to 0 (the logger's flush-time report).
+    std::uint64_t take_suppressed() noexcept { return suppressed.exchange(0, std::memory_order_relaxed); }
 
-        replace_all(out, "{ts}", make_timestamp(e.ts));
-        replace_all(out, "{date}", date_string(e.ts));
-        replace_all(out, "{time}", time_string(e.ts));
-        replace_all(out, "{ms}", std::format("{:03}", ms));
-        replace_all(out, "{lvl}", std::string(level_name(e.lvl)));
-        replace_all(out, "{name}", e.name);
-        replace_all(out, "{tid}", thread_id_string(e.tid));
-        replace_all(out, "{msg}", e.payload);
-        replace_all(out, "{file}", std::string(e.loc.file_name()));
-        replace_all(out, "{line}", std::to_string(e.loc.line()));
-        replace_all(out, "{func}", std::string(e.loc.function_name()));
+    bool window_over(std::int64_t now_ns) const noexcept { return now_ns >= window_end.load(std::memory_order_relaxed); }
 
-        return out;
+    static std::int64_t clock_ns() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count();
     }
 };
 
-class console_sink : public sink {
+// A call site's format string, recorded by its first call that passes a compile-time checked
+// one: std::format_string only accepts constants, so the text has static storage. Stays empty
+// for sites that only see runtime formats or structured messages.
+class site_format {
 public:
-    enum class style { plain, color };
-    explicit console_sink(style s = style::plain) : style_(s) {}
+    site_format() noexcept = default;
 
-    void log(const log_event& e) override {
-        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
-        const auto line = render(e);
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (style_ == style::color) {
-                std::cout << color_of(e.lvl) << line << "\x1b[0m\n";
-            } else {
-                std::cout << line << '\n';
-            }
-        } else {
-            if (style_ == style::color) {
-                std::cout << color_of(e.lvl) << line << "\x1b[0m\n";
-            } else {
-                std::cout << line << '\n';
-            }
-        }
+    std::string_view view() const noexcept {
+        const char* p = data_.load(std::memory_order_acquire);
+        return p ? std::string_view(p, size_.load(std::memory_order_relaxed)) : std::string_view{};
     }
 
-    void flush() override {
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            std::cout << std::flush;
-        } else {
-            std::cout << std::flush;
-        }
+    // Racing first calls store the same text (one expansion, one literal).
+    void record(std::string_view s) const noexcept {
+        if (data_.load(std::memory_order_relaxed)) return;
+        size_.store(s.size(), std::memory_order_relaxed);
+        data_.store(s.data(), std::memory_order_release);
     }
 
 private:
-    static const char* color_of(level lv) noexcept {
-        switch (lv) {
-            case level::trace: return "\x1b[37m";
-            case level::debug: return "\x1b[36m";
-            case level::info: return "\x1b[32m";
-            case level::warn: return "\x1b[33m";
-            case level::error: return "\x1b[31m";
-            case level::critical: return "\x1b[1;31m";
-            case level::off: return "\x1b[0m";
-        }
-        return "\x1b[0m";
-    }
+    mutable std::atomic<const char*> data_{nullptr};
+    mutable std::atomic<std::size_t> size_{0};
+};
 
-    style style_;
-    std::mutex m_;
+} // namespace detail
+
+// Static per-call-site metadata. The CHLOG_* macros create one of these per expansion (a
+// function-local static, initialized on first use), so events only carry a pointer to it.
+struct call_site {
+    std::source_location loc{};
+    level lvl = level::off;    // level named at the call site; off when only known at runtime
+    detail::site_format fmt{}; // checked format string, once the site has been called with one
+    bool shared = false;       // stands for many call sites (logger::log()); never rate limited
+    mutable detail::site_limiter limiter{};
 };
 
-class rotating_file_sink : public sink {
+// Byte string with inline storage for short payloads: up to inline_capacity bytes live inside
+// the object (and so inside the event / queue cell), longer ones fall back to the heap. The heap
+// block is kept when the buffer is reused (byte_ring decode slots, materialized payloads).
+// Converts implicitly to std::string_view; use str() for an owning std::string.
+//
+// An optional trailer (binary data stored right after the text, see trailer()) travels with the
+// buffer through copies and moves but is not part of the text: size(), the string_view
+// conversion and str() cover the text alone. Changing the text drops the trailer.
+class payload_buffer {
 public:
-    rotating_file_sink(std::filesystem::path path, std::size_t max_bytes, std::size_t max_files)
-        : path_(std::move(path)), max_bytes_(max_bytes), max_files_(max_files ? max_files : 1) {
-        if (!path_.parent_path().empty()) {
-            std::filesystem::create_directories(path_.parent_path());
-        }
-        open();
-    }
+    static constexpr std::size_t inline_capacity = 152; // keeps sizeof(log_event) at 256 bytes on LP64
 
-    void log(const log_event& e) override {
-        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
-        const auto line = render(e);
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (!file_.is_open()) return;
-            file_ << line << '\n';
-            bytes_ += line.size() + 1;
-            if (bytes_ >= max_bytes_) rotate();
-        } else {
-            if (!file_.is_open()) return;
-            file_ << line << '\n';
-            bytes_ += line.size() + 1;
-            if (bytes_ >= max_bytes_) rotate();
-        }
-    }
+    payload_buffer() noexcept = default;
+    payload_buffer(std::string_view s) { assign(s); } // NOLINT(google-explicit-constructor)
+    payload_buffer(const payload_buffer& o) { copy(o); }
+    payload_buffer(payload_buffer&& o) noexcept { steal(o); }
 
-    void flush() override {
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (file_.is_open()) file_.flush();
-        } else {
-            if (file_.is_open()) file_.flush();
+    payload_buffer& operator=(const payload_buffer& o) {
+        if (this != &o) copy(o);
+        return *this;
+    }
+    payload_buffer& operator=(payload_buffer&& o) noexcept {
+        if (this != &o) {
+            delete[] heap_;
+            steal(o);
         }
+        return *this;
     }
-
-private:
-    void open() {
-        file_.open(path_, std::ios::out | std::ios::app);
-        std::error_code ec;
-        bytes_ = std::filesystem::exists(path_, ec) ? static_cast<std::size_t>(std::filesystem::file_size(path_, ec)) : 0;
-        if (ec) bytes_ = 0;
+    payload_buffer& operator=(std::string_view s) {
+        assign(s);
+        return *this;
     }
 
-    void rotate() {
-        if (!file_.is_open()) return;
-        file_.flush();
-        file_.close();
+    ~payload_buffer() { delete[] heap_; }
 
-        std::error_code ec;
-        // Remove the last one to make space.
-        const auto last = path_.string() + "." + std::to_string(max_files_);
-        if (std::filesystem::exists(last, ec)) {
-            std::filesystem::remove(last, ec);
-        }
+    const char* data() const noexcept { return heap_ ? heap_ : inline_; }
+    char* data() noexcept { return heap_ ? heap_ : inline_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    std::size_t capacity() const noexcept { return cap_; }
+    const char* begin() const noexcept { return data(); }
+    const char* end() const noexcept { return data() + size_; }
 
-        for (std::size_t i = max_files_ - 1; i >= 1; --i) {
-            const auto src = path_.string() + "." + std::to_string(i);
-            const auto dst = path_.string() + "." + std::to_string(i + 1);
-            if (std::filesystem::exists(src, ec)) {
-                std::filesystem::rename(src, dst, ec);
-            }
-            if (i == 1) break;
-        }
+    operator std::string_view() const noexcept { return {data(), size_}; } // NOLINT(google-explicit-constructor)
+    std::string str() const { return std::string(data(), size_); }
 
-        const auto first = path_.string() + ".1";
-        if (std::filesystem::exists(path_, ec)) {
-            std::filesystem::rename(path_, first, ec);
-        }
+    void clear() noexcept { size_ = trailer_ = 0; }
 
-        open();
+    // Replaces the contents; `p` must not point into this buffer.
+    void assign(const char* p, std::size_t n) {
+        if (n > cap_) reallocate(n, false);
+        if (n) std::memcpy(data(), p, n);
+        size_ = static_cast<std::uint32_t>(n);
+        trailer_ = 0;
+    }
+    void assign(std::string_view s) { assign(s.data(), s.size()); }
+
+    void append(std::string_view s) {
+        trailer_ = 0;
+        if (s.empty()) return;
+        if (size_ + s.size() > cap_) reallocate(std::max<std::size_t>(size_ + s.size(), std::size_t{cap_} * 2), true);
+        std::memcpy(data() + size_, s.data(), s.size());
+        size_ = static_cast<std::uint32_t>(size_ + s.size());
     }
+    void push_back(char c) { append(std::string_view(&c, 1)); }
 
-    std::filesystem::path path_;
-    std::size_t max_bytes_{};
-    std::size_t max_files_{};
-    std::ofstream file_;
-    std::size_t bytes_ = 0;
-    std::mutex m_;
-};
+    // New bytes (when growing) are left uninitialized.
+    void resize(std::size_t n) {
+        if (n > cap_) reallocate(n, true);
+        size_ = static_cast<std::uint32_t>(n);
+        trailer_ = 0;
+    }
 
-class daily_file_sink : public sink {
-public:
-    explicit daily_file_sink(std::filesystem::path dir) : dir_(std::move(dir)) {
-        std::filesystem::create_directories(dir_);
-        open(date_string(std::chrono::system_clock::now()));
+    // `n` bytes of text followed by a `trailer`-byte trailer, both uninitialized; returns the
+    // start of the text (the trailer begins at data() + n).
+    char* resize(std::size_t n, std::size_t trailer) {
+        if (n + trailer > cap_) reallocate(n + trailer, false);
+        size_ = static_cast<std::uint32_t>(n);
+        trailer_ = static_cast<std::uint32_t>(trailer);
+        return data();
     }
 
-    void log(const log_event& e) override {
-        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
-        const auto day = date_string(e.ts);
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (day != current_day_) rotate(day);
-            if (!file_.is_open()) return;
-            file_ << render(e) << '\n';
+    std::string_view trailer() const noexcept { return {data() + size_, trailer_}; }
+
+    friend bool operator==(const payload_buffer& a, std::string_view b) noexcept { return std::string_view(a) == b; }
+
+private:
+    void reallocate(std::size_t n, bool keep) {
+        if (n > std::numeric_limits<std::uint32_t>::max()) throw std::length_error("chlog: payload too large");
+        char* next = new char[n];
+        if (keep && size_) std::memcpy(next, data(), size_);
+        delete[] heap_;
+        heap_ = next;
+        cap_ = static_cast<std::uint32_t>(n);
+    }
+
+    void copy(const payload_buffer& o) {
+        const std::size_t n = std::size_t{o.size_} + o.trailer_;
+        if (n > cap_) reallocate(n, false);
+        if (n) std::memcpy(data(), o.data(), n);
+        size_ = o.size_;
+        trailer_ = o.trailer_;
+    }
+
+    void steal(payload_buffer& o) noexcept {
+        size_ = o.size_;
+        trailer_ = o.trailer_;
+        if (o.heap_) {
+            heap_ = o.heap_;
+            cap_ = o.cap_;
+            o.heap_ = nullptr;
+            o.cap_ = inline_capacity;
         } else {
-            if (day != current_day_) rotate(day);
-            if (!file_.is_open()) return;
-            file_ << render(e) << '\n';
+            heap_ = nullptr;
+            cap_ = inline_capacity;
+            if (size_ + trailer_) std::memcpy(inline_, o.inline_, size_ + trailer_);
         }
+        o.size_ = o.trailer_ = 0;
     }
 
-    void flush() override {
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (file_.is_open()) file_.flush();
+    char* heap_ = nullptr;
+    std::uint32_t size_ = 0;
+    std::uint32_t cap_ = inline_capacity;
+    std::uint32_t trailer_ = 0;
+    char inline_[inline_capacity];
+};
+
+// =========================== Structured Fields ===========================
+// kv("key", value) arguments attach typed fields to an event without formatting them on the
+// calling thread: the message is copied verbatim and each field is appended to the payload as
+// a small binary record (no to_chars, no escaping). Sinks encode them natively: JSON members in
+// json_sink and "{json}", raw records in binary_file_sink, and " key=value" after the message
+// wherever a text pattern renders {msg}.
+//
+// Record layout (host byte order): u8 type, u8 key length, key bytes, then the value:
+//   'q' i64, 'Q' u64, 'd' f64, '?' u8, 's' u32 length + bytes
+// Integers widen to 64 bits, floating point to double, enums to their underlying type; strings
+// (std::string, std::string_view, const char*, char arrays, char) are copied. Keys longer than
+// 255 bytes are cut.
+
+enum class field_type : char { i64 = 'q', u64 = 'Q', f64 = 'd', boolean = '?', str = 's' };
+
+template <class T>
+struct kv_field {
+    std::string_view key;
+    T value; // arithmetic, enum or std::string_view (see kv())
+};
+
+namespace detail {
+
+template <class T>
+struct is_kv_field : std::false_type {};
+template <class T>
+struct is_kv_field<kv_field<T>> : std::true_type {};
+
+// A structured call: every argument after the message is a kv() field.
+template <class... A>
+concept field_list = sizeof...(A) > 0 && (is_kv_field<std::remove_cvref_t<A>>::value && ...);
+
+template <class T>
+inline constexpr bool is_kv_value_v =
+    is_string_arg_v<std::decay_t<T>> || std::is_arithmetic_v<std::decay_t<T>> || std::is_enum_v<std::decay_t<T>>;
+
+template <class T>
+using kv_value_t = std::conditional_t<is_string_arg_v<std::decay_t<T>>, std::string_view, std::decay_t<T>>;
+
+template <class T>
+constexpr field_type field_type_of() noexcept {
+    if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, char>) return field_type::str;
+    else if constexpr (std::is_enum_v<T>) return field_type_of<std::underlying_type_t<T>>();
+    else if constexpr (std::is_same_v<T, bool>) return field_type::boolean;
+    else if constexpr (std::is_floating_point_v<T>) return field_type::f64;
+    else if constexpr (std::is_signed_v<T>) return field_type::i64;
+    else return field_type::u64;
+}
+
+inline constexpr std::size_t max_field_key = 255;
+
+template <class T>
+inline std::size_t encoded_field_size(const kv_field<T>& f) noexcept {
+    const std::size_t head = 2 + std::min(f.key.size(), max_field_key);
+    if constexpr (std::is_same_v<T, std::string_view>) return head + sizeof(std::uint32_t) + f.value.size();
+    else if constexpr (std::is_same_v<T, char>) return head + sizeof(std::uint32_t) + 1;
+    else if constexpr (std::is_same_v<T, bool>) return head + 1;
+    else return head + 8;
+}
+
+template <class T>
+inline void encode_field(char*& p, const kv_field<T>& f) noexcept {
+    const std::size_t klen = std::min(f.key.size(), max_field_key);
+    *p++ = static_cast<char>(field_type_of<T>());
+    *p++ = static_cast<char>(static_cast<unsigned char>(klen));
+    if (klen) std::memcpy(p, f.key.data(), klen);
+    p += klen;
+    auto put = [&p](const auto v) {
+        std::memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    };
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        put(static_cast<std::uint32_t>(f.value.size()));
+        if (!f.value.empty()) std::memcpy(p, f.value.data(), f.value.size());
+        p += f.value.size();
+    } else if constexpr (std::is_same_v<T, char>) {
+        put(std::uint32_t{1});
+        *p++ = f.value;
+    } else if constexpr (field_type_of<T>() == field_type::boolean) {
+        *p++ = static_cast<char>(static_cast<bool>(f.value) ? 1 : 0);
+    } else if constexpr (field_type_of<T>() == field_type::f64) {
+        put(static_cast<double>(f.value));
+    } else if constexpr (field_type_of<T>() == field_type::i64) {
+        put(static_cast<std::int64_t>(f.value));
+    } else {
+        put(static_cast<std::uint64_t>(f.value));
+    }
+}
+
+// Writes `msg` into `out` and the field records into its trailer.
+template <class Out, class... Fields>
+inline void encode_fields(Out& out, std::string_view msg, const Fields&... fields) {
+    const std::size_t n = (std::size_t{0} + ... + encoded_field_size(fields));
+    char* p = out.resize(msg.size(), n);
+    if (!msg.empty()) std::memcpy(p, msg.data(), msg.size());
+    p += msg.size();
+    (encode_field(p, fields), ...);
+}
+
+} // namespace detail
+
+// Typed field for structured logging: lg.info("req done", kv("lat_us", 42), kv("path", sv)).
+// String values are referenced, not copied, until the log call copies them into the event.
+template <class T>
+constexpr kv_field<detail::kv_value_t<T>> kv(std::string_view key, T&& value) noexcept {
+    static_assert(detail::is_kv_value_v<T>, "chlog::kv: the value must be arithmetic, an enum or string-like");
+    if constexpr (detail::is_string_arg_v<std::decay_t<T>>) {
+        return {key, detail::as_string_arg(value)};
+    } else {
+        return {key, value};
+    }
+}
+
+// One decoded field (log_event::fields()); only the member matching `type` is meaningful.
+struct field_view {
+    std::string_view key;
+    field_type type = field_type::i64;
+    std::int64_t i64 = 0;
+    std::uint64_t u64 = 0;
+    double f64 = 0.0;
+    bool boolean = false;
+    std::string_view str;
+};
+
+// Forward range over the field records at the end of an event's payload.
+class field_range {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = field_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const field_view*;
+        using reference = const field_view&;
+
+        iterator() noexcept = default;
+        iterator(const char* p, const char* end) noexcept : p_(p), end_(end) { decode(); }
+
+        reference operator*() const noexcept { return cur_; }
+        pointer operator->() const noexcept { return &cur_; }
+        iterator& operator++() noexcept {
+            p_ = next_;
+            decode();
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        friend bool operator==(const iterator& a, const iterator& b) noexcept { return a.p_ == b.p_; }
+
+    private:
+        void decode() noexcept {
+            if (p_ == end_) return;
+            const char* p = p_;
+            cur_ = field_view{};
+            cur_.type = static_cast<field_type>(*p++);
+            const std::size_t klen = static_cast<unsigned char>(*p++);
+            cur_.key = std::string_view(p, klen);
+            p += klen;
+            switch (cur_.type) {
+                case field_type::str: {
+                    std::uint32_t n = 0;
+                    std::memcpy(&n, p, sizeof(n));
+                    p += sizeof(n);
+                    cur_.str = std::string_view(p, n);
+                    p += n;
+                    break;
+                }
+                case field_type::boolean: cur_.boolean = *p++ != 0; break;
+                case field_type::f64: std::memcpy(&cur_.f64, p, 8); p += 8; break;
+                case field_type::i64: std::memcpy(&cur_.i64, p, 8); p += 8; break;
+                case field_type::u64: std::memcpy(&cur_.u64, p, 8); p += 8; break;
+            }
+            next_ = p;
+        }
+
+        const char* p_ = nullptr;
+        const char* end_ = nullptr;
+        const char* next_ = nullptr;
+        field_view cur_{};
+    };
+
+    field_range() noexcept = default;
+    explicit field_range(std::string_view records) noexcept : records_(records) {}
+
+    iterator begin() const noexcept { return {records_.data(), records_.data() + records_.size()}; }
+    iterator end() const noexcept {
+        const char* e = records_.data() + records_.size();
+        return {e, e};
+    }
+    bool empty() const noexcept { return records_.empty(); }
+    std::string_view records() const noexcept { return records_; } // encoded form (see above)
+
+private:
+    std::string_view records_;
+};
+
+struct log_event {
+    std::chrono::system_clock::time_point ts;
+    level lvl{};
+    std::uint32_t origin{}; // routing id of the submitting logger on a shared async_backend
+    std::thread::id tid{};
+    std::string_view name; // the logger's name, interned for the life of the process
+    payload_buffer payload; // formatted message (or encoded arguments, see `deferred`)
+    std::uint64_t seq{};
+
+    const call_site* site = nullptr; // null when source location capture is off
+
+    std::string_view file() const noexcept { return site ? site->loc.file_name() : std::string_view{}; }
+    std::uint_least32_t line() const noexcept { return site ? site->loc.line() : 0; }
+    std::string_view func() const noexcept { return site ? site->loc.function_name() : std::string_view{}; }
+    // The call site's full location (what the former `loc` member held); empty when not captured.
+    std::source_location loc() const noexcept { return site ? site->loc : std::source_location{}; }
+
+    // Deferred formatting (async.deferred_format): when non-null, `payload` holds encoded
+    // arguments for `deferred_fmt` and the async worker replaces it with the formatted text
+    // before the event reaches any sink (unless every sink accepts_deferred()).
+    const detail::deferred_codec* deferred = nullptr;
+    std::string_view deferred_fmt;
+
+    // Structured fields (kv()): the field records are payload's trailer, so `payload` itself
+    // stays the message text for sinks that don't know about fields.
+    std::string_view message() const noexcept { return payload; }
+    bool has_fields() const noexcept { return !payload.trailer().empty(); }
+    field_range fields() const noexcept { return field_range(payload.trailer()); }
+};
+
+namespace detail {
+
+// Maps a runtime std::source_location to a stable call_site. The global table only grows (one
+// entry per distinct location); each thread keeps a small direct-mapped cache in front of it.
+inline const call_site* intern_site(const std::source_location& loc) {
+    struct cache_entry {
+        const char* file = nullptr;
+        const char* func = nullptr;
+        std::uint_least32_t line = 0;
+        std::uint_least32_t column = 0;
+        const call_site* site = nullptr;
+    };
+    static constexpr std::size_t cache_size = 64;
+    thread_local cache_entry cache[cache_size];
+
+    const auto file_key = reinterpret_cast<std::uintptr_t>(loc.file_name());
+    const auto func_key = reinterpret_cast<std::uintptr_t>(loc.function_name());
+    auto& c = cache[(file_key ^ (loc.line() * 0x9E3779B1u) ^ loc.column()) & (cache_size - 1)];
+    if (c.site && c.file == loc.file_name() && c.func == loc.function_name() && c.line == loc.line() &&
+        c.column == loc.column())
+        return c.site;
+
+    using key = std::tuple<std::uintptr_t, std::uintptr_t, std::uint_least32_t, std::uint_least32_t>;
+    static std::mutex mu;
+    static std::map<key, std::unique_ptr<call_site>> table;
+
+    const call_site* site = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(mu);
+        auto& slot = table[key{file_key, func_key, loc.line(), loc.column()}];
+        if (!slot) {
+            slot = std::make_unique<call_site>();
+            slot->loc = loc;
+        }
+        site = slot.get();
+    }
+    c = cache_entry{loc.file_name(), loc.function_name(), loc.line(), loc.column(), site};
+    return site;
+}
+
+// Logger names are interned once per distinct name and never freed, like call sites: events
+// carry a view of the name and can outlive their logger (sink worker queues, shared backends,
+// sinks that keep events around).
+inline std::string_view intern_name(std::string_view name) {
+    static std::mutex mu;
+    static std::set<std::string, std::less<>> names;
+    std::lock_guard<std::mutex> lk(mu);
+    auto it = names.find(name);
+    if (it == names.end()) it = names.emplace(name).first;
+    return *it;
+}
+
+} // namespace detail
+
+// Log-bucketed (HDR-style) histogram: values below 16 are exact, larger ones fall into 8
+// sub-buckets per power of two, so any reported value is within 12.5% of the recorded one.
+// `buckets` is empty until something has been recorded.
+struct latency_histogram {
+    static constexpr unsigned sub_bits = 3;
+    static constexpr std::size_t bucket_count = (2u << sub_bits) + ((63 - sub_bits) << sub_bits);
+
+    std::vector<std::uint64_t> buckets;
+    std::uint64_t count{};
+    std::uint64_t sum{};
+    std::uint64_t max_value{};
+
+    static constexpr std::size_t bucket_of(std::uint64_t v) noexcept {
+        if (v < (2u << sub_bits)) return static_cast<std::size_t>(v);
+        const unsigned e = static_cast<unsigned>(std::bit_width(v)) - 1;
+        return (2u << sub_bits) + (static_cast<std::size_t>(e - sub_bits - 1) << sub_bits) +
+               static_cast<std::size_t>((v >> (e - sub_bits)) & ((1u << sub_bits) - 1));
+    }
+
+    static constexpr std::uint64_t bucket_lower(std::size_t b) noexcept {
+        if (b < (2u << sub_bits)) return b;
+        const std::size_t k = b - (2u << sub_bits);
+        const unsigned e = static_cast<unsigned>(k >> sub_bits) + sub_bits + 1;
+        return ((std::uint64_t{1} << sub_bits) + (k & ((1u << sub_bits) - 1))) << (e - sub_bits);
+    }
+
+    static constexpr std::uint64_t bucket_upper(std::size_t b) noexcept {
+        return b + 1 < bucket_count ? bucket_lower(b + 1) - 1 : std::numeric_limits<std::uint64_t>::max();
+    }
+
+    double mean() const noexcept { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+
+    // Upper bound of the bucket holding the q-quantile (q in [0, 1]), capped at max_value.
+    std::uint64_t percentile(double q) const noexcept {
+        if (count == 0) return 0;
+        const double want = std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count));
+        const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(want));
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < buckets.size(); ++b) {
+            seen += buckets[b];
+            if (seen >= rank) return std::min(bucket_upper(b), max_value);
+        }
+        return max_value;
+    }
+
+    void merge(const latency_histogram& o) {
+        if (o.count == 0) return;
+        if (buckets.empty()) buckets.assign(bucket_count, 0);
+        for (std::size_t b = 0; b < o.buckets.size(); ++b) buckets[b] += o.buckets[b];
+        count += o.count;
+        sum += o.sum;
+        max_value = std::max(max_value, o.max_value);
+    }
+};
+
+// One ring of the async queue. Units are events for the ring / per_thread backends (for
+// per_thread, capacity is per producer thread and size sums all threads) and bytes for byte_ring.
+struct ring_stats {
+    std::size_t capacity{};
+    std::size_t size{};           // occupancy when stats() ran
+    std::size_t high_watermark{}; // highest occupancy seen by the worker at the start of a batch
+    std::size_t dropped{};        // events dropped because this ring was full
+    std::size_t blocked{};        // producers that found it full and waited (push_blocking)
+};
+
+// Delivery counters of a sink that reports them (sink::report), e.g. the network sinks.
+struct sink_stats {
+    std::string target;            // where it ships to, e.g. "syslog+udp://host:514"
+    std::size_t sent{};            // messages delivered
+    std::size_t dropped{};         // messages lost: buffer full, rejected, or unsent at shutdown
+    std::size_t bytes_sent{};
+    std::size_t buffered_bytes{};  // rendered bytes waiting to be sent
+    std::size_t reconnects{};
+    std::size_t errors{};          // failed connects / sends and rejected batches
+};
+
+struct metrics_snapshot {
+    std::size_t dropped{};
+    std::size_t enqueued{};
+    std::size_t dequeued{};
+    std::size_t flushed{};
+    std::size_t queue_size{};
+
+    std::array<std::size_t, level_count> dropped_by_level{}; // indexed by static_cast<int>(level)
+    std::size_t blocked{};         // log calls that fell back to push_blocking
+    std::vector<ring_stats> rings; // async only: one per lane, highest priority first
+    std::vector<ring_stats> sink_queues; // async.sink_workers: one per sink worker, in event counts
+    std::vector<sink_stats> sinks;       // one per attached sink that reports delivery counters
+
+    // Only populated with logger_config::latency_histograms.
+    latency_histogram call_ns;                    // time spent inside a log call (format + enqueue/write)
+    latency_histogram queue_ns;                   // async: event timestamp -> handed to the sinks
+    latency_histogram batch_size;                 // async: events per worker batch
+    std::vector<latency_histogram> sink_write_ns; // per sink (add_sink order): one log()/log_batch() call
+};
+
+// Producer-written and worker-written counters live on separate cache lines; the drop/blocked
+// group is only touched when a queue is full, so it gets its own line too.
+struct metrics {
+    alignas(64) std::atomic<std::size_t> enqueued{0};
+
+    alignas(64) std::atomic<std::size_t> dropped{0};
+    std::atomic<std::size_t> blocked{0};
+    std::atomic<std::size_t> dropped_by_level[level_count]{};
+
+    alignas(64) std::atomic<std::size_t> dequeued{0};
+    std::atomic<std::size_t> flushed{0};
+    std::atomic<std::size_t> queue_size{0};
+};
+
+namespace detail {
+
+// Single-writer histogram: only the owning thread records (relaxed load + store, no RMW), and
+// stats() reads it concurrently. A snapshot may be slightly torn across buckets, never corrupt.
+struct histogram_shard {
+    std::atomic<std::uint64_t> buckets[latency_histogram::bucket_count]{};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> max_value{0};
+
+    static void bump(std::atomic<std::uint64_t>& a, std::uint64_t d) noexcept {
+        a.store(a.load(std::memory_order_relaxed) + d, std::memory_order_relaxed);
+    }
+
+    void record(std::uint64_t v) noexcept {
+        bump(buckets[latency_histogram::bucket_of(v)], 1);
+        bump(sum, v);
+        if (v > max_value.load(std::memory_order_relaxed)) max_value.store(v, std::memory_order_relaxed);
+    }
+
+    void add_to(latency_histogram& h) const {
+        latency_histogram part;
+        part.buckets.resize(latency_histogram::bucket_count);
+        for (std::size_t b = 0; b < latency_histogram::bucket_count; ++b) {
+            part.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+            part.count += part.buckets[b];
+        }
+        part.sum = sum.load(std::memory_order_relaxed);
+        part.max_value = max_value.load(std::memory_order_relaxed);
+        h.merge(part);
+    }
+};
+
+// One thread's histograms for one logger. Per-sink histograms are allocated on first use.
+struct latency_shard {
+    static constexpr std::size_t max_sinks = 16; // later sinks are not timed
+
+    histogram_shard call;
+    histogram_shard queue;
+    histogram_shard batch;
+    std::atomic<histogram_shard*> sinks[max_sinks]{};
+    std::atomic<bool> closed{false}; // owning logger destroyed
+
+    latency_shard() = default;
+    latency_shard(const latency_shard&) = delete;
+    latency_shard& operator=(const latency_shard&) = delete;
+    ~latency_shard() {
+        for (auto& h : sinks) delete h.load(std::memory_order_relaxed);
+    }
+
+    histogram_shard* sink(std::size_t i) {
+        if (i >= max_sinks) return nullptr;
+        histogram_shard* h = sinks[i].load(std::memory_order_relaxed);
+        if (!h) {
+            h = new histogram_shard();
+            sinks[i].store(h, std::memory_order_release);
+        }
+        return h;
+    }
+};
+
+// Per-logger registry of latency shards; each recording thread lazily registers its own, the
+// same way per_thread_queue hands out producer rings.
+class latency_registry {
+public:
+    latency_registry() = default;
+    latency_registry(const latency_registry&) = delete;
+    latency_registry& operator=(const latency_registry&) = delete;
+
+    ~latency_registry() {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (auto& sh : shards_) sh->closed.store(true, std::memory_order_relaxed);
+    }
+
+    latency_shard& local() {
+        thread_local std::vector<std::pair<std::uint64_t, std::shared_ptr<latency_shard>>> mine;
+        for (auto& [id, sh] : mine) {
+            if (id == id_) return *sh;
+        }
+
+        std::erase_if(mine, [](const auto& entry) { return entry.second->closed.load(std::memory_order_relaxed); });
+        auto sh = std::make_shared<latency_shard>();
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            shards_.push_back(sh);
+        }
+        mine.emplace_back(id_, sh);
+        return *sh;
+    }
+
+    // Shards of exited threads are kept, so the histograms cover the logger's whole lifetime.
+    void snapshot(metrics_snapshot& snap) const {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (const auto& sh : shards_) {
+            sh->call.add_to(snap.call_ns);
+            sh->queue.add_to(snap.queue_ns);
+            sh->batch.add_to(snap.batch_size);
+            for (std::size_t i = 0; i < latency_shard::max_sinks; ++i) {
+                const histogram_shard* h = sh->sinks[i].load(std::memory_order_acquire);
+                if (!h) continue;
+                if (snap.sink_write_ns.size() <= i) snap.sink_write_ns.resize(i + 1);
+                h->add_to(snap.sink_write_ns[i]);
+            }
+        }
+    }
+
+private:
+    static std::uint64_t next_id() noexcept {
+        static std::atomic<std::uint64_t> id{0};
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    mutable std::mutex mu_;
+    std::vector<std::shared_ptr<latency_shard>> shards_;
+    const std::uint64_t id_ = next_id();
+};
+
+inline std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point since) noexcept {
+    const auto d = std::chrono::steady_clock::now() - since;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+// Runs f(), recording its duration into h when h is non-null.
+template <class F>
+void timed(histogram_shard* h, F&& f) {
+    if (!h) {
+        f();
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    h->record(elapsed_ns(start));
+}
+
+// Records the lifetime of a log call (no clock reads when h is null).
+class call_timer {
+public:
+    explicit call_timer(histogram_shard* h) noexcept : h_(h) {
+        if (h_) start_ = std::chrono::steady_clock::now();
+    }
+    call_timer(const call_timer&) = delete;
+    call_timer& operator=(const call_timer&) = delete;
+    ~call_timer() {
+        if (h_) h_->record(elapsed_ns(start_));
+    }
+
+private:
+    histogram_shard* h_;
+    std::chrono::steady_clock::time_point start_{};
+};
+
+} // namespace detail
+
+// =========================== Time / Formatting Utils ===========================
+
+inline std::tm localtime_safe(std::time_t t) noexcept {
+    std::tm tm{};
+#ifdef _WIN32
+    ::localtime_s(&tm, &t);
+#else
+    ::localtime_r(&t, &tm);
+#endif
+    return tm;
+}
+
+namespace detail {
+
+inline void write_padded(char* dst, unsigned v, int width) noexcept {
+    for (int i = width - 1; i >= 0; --i) {
+        dst[i] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    }
+}
+
+// Per-thread cache of the formatted "YYYY-MM-DD HH:MM:SS" prefix for the current second.
+// localtime + formatting only happens when the second changes; sub-second digits are
+// written fresh by the caller. Being thread_local it is safe for sinks rendering
+// concurrently (parallel_sinks) and for user sinks calling render() without a lock.
+struct time_cache {
+    std::int64_t sec = (std::numeric_limits<std::int64_t>::min)();
+    char buf[19]{};
+
+    std::string_view datetime() const noexcept { return {buf, 19}; }
+    std::string_view date() const noexcept { return {buf, 10}; }
+    std::string_view time() const noexcept { return {buf + 11, 8}; }
+};
+
+inline const time_cache& cached_time(std::chrono::system_clock::time_point tp) noexcept {
+    thread_local time_cache tc;
+    const auto secs = std::chrono::floor<std::chrono::seconds>(tp);
+    const std::int64_t sec = secs.time_since_epoch().count();
+    if (sec != tc.sec) {
+        const auto tm = localtime_safe(std::chrono::system_clock::to_time_t(secs));
+        write_padded(tc.buf, static_cast<unsigned>(tm.tm_year + 1900), 4);
+        tc.buf[4] = '-';
+        write_padded(tc.buf + 5, static_cast<unsigned>(tm.tm_mon + 1), 2);
+        tc.buf[7] = '-';
+        write_padded(tc.buf + 8, static_cast<unsigned>(tm.tm_mday), 2);
+        tc.buf[10] = ' ';
+        write_padded(tc.buf + 11, static_cast<unsigned>(tm.tm_hour), 2);
+        tc.buf[13] = ':';
+        write_padded(tc.buf + 14, static_cast<unsigned>(tm.tm_min), 2);
+        tc.buf[16] = ':';
+        write_padded(tc.buf + 17, static_cast<unsigned>(tm.tm_sec), 2);
+        tc.sec = sec;
+    }
+    return tc;
+}
+
+// Sub-second part of `tp`, in units of Period (e.g. std::milli => 0..999).
+template <class Period>
+inline unsigned subsecond(std::chrono::system_clock::time_point tp) noexcept {
+    const auto d = tp - std::chrono::floor<std::chrono::seconds>(tp);
+    return static_cast<unsigned>(std::chrono::duration_cast<std::chrono::duration<std::int64_t, Period>>(d).count());
+}
+
+// Appends "YYYY-MM-DD HH:MM:SS.mmm".
+inline void append_timestamp(std::string& out, std::chrono::system_clock::time_point tp) {
+    char buf[23];
+    std::memcpy(buf, cached_time(tp).buf, 19);
+    buf[19] = '.';
+    write_padded(buf + 20, subsecond<std::milli>(tp), 3);
+    out.append(buf, sizeof(buf));
+}
+
+} // namespace detail
+
+inline std::string make_timestamp(std::chrono::system_clock::time_point tp) {
+    std::string out;
+    detail::append_timestamp(out, tp);
+    return out;
+}
+
+inline std::string date_string(std::chrono::system_clock::time_point tp) {
+    return std::string(detail::cached_time(tp).date());
+}
+
+inline std::string time_string(std::chrono::system_clock::time_point tp) {
+    return std::string(detail::cached_time(tp).time());
+}
+
+inline std::string thread_id_string(std::thread::id tid) {
+    std::ostringstream oss;
+    oss << tid;
+    return oss.str();
+}
+
+namespace detail {
+
+// Appends the textual thread id; the string is computed once per thread and reused.
+inline void append_thread_id(std::string& out, std::thread::id tid) {
+    struct cache {
+        std::thread::id id{};
+        std::string text;
+    };
+    thread_local cache c;
+    if (c.id != tid || c.text.empty()) {
+        c.text = thread_id_string(tid);
+        c.id = tid;
+    }
+    out.append(c.text);
+}
+
+inline bool json_needs_escape(unsigned char c) noexcept { return c < 0x20 || c == '"' || c == '\\'; }
+
+// Returns the first byte in [p, end) that must be escaped (or end). Scans 16/32 bytes per step
+// where SIMD is available, otherwise 8 bytes per step with SWAR.
+inline const char* json_find_escape(const char* p, const char* end) noexcept {
+#if defined(CHLOG_SIMD_SSE2)
+    #if defined(__AVX2__)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i bslash = _mm256_set1_epi8('\\');
+        const __m256i ctrl = _mm256_set1_epi8(0x1F);
+        while (end - p >= 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i hit = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v));
+            const auto m = static_cast<std::uint32_t>(_mm256_movemask_epi8(hit));
+            if (m) return p + std::countr_zero(m);
+            p += 32;
+        }
+    }
+    #endif
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                                         _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+        const auto m = static_cast<std::uint32_t>(_mm_movemask_epi8(hit));
+        if (m) return p + std::countr_zero(m);
+        p += 16;
+    }
+#elif defined(CHLOG_SIMD_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t bslash = vdupq_n_u8('\\');
+    const uint8x16_t ctrl = vdupq_n_u8(0x20);
+    while (end - p >= 16) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+        const uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)), vcltq_u8(v, ctrl));
+        if (vmaxvq_u8(hit)) break; // locate the exact byte below
+        p += 16;
+    }
+#else
+    // SWAR: a byte is a hit if it is < 0x20, '"' or '\\' (classic haszero/hasless bit tricks).
+    constexpr std::uint64_t ones = 0x0101010101010101ull;
+    constexpr std::uint64_t highs = 0x8080808080808080ull;
+    const auto has_zero = [](std::uint64_t x) noexcept { return (x - ones) & ~x & highs; };
+    while (end - p >= 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        const std::uint64_t hit =
+            ((w - ones * 0x20) & ~w & highs) | has_zero(w ^ (ones * '"')) | has_zero(w ^ (ones * '\\'));
+        if (hit) break; // locate the exact byte below
+        p += 8;
+    }
+#endif
+    while (p < end && !json_needs_escape(static_cast<unsigned char>(*p))) ++p;
+    return p;
+}
+
+// Appends `s` JSON-escaped (without surrounding quotes). Clean runs are copied in bulk.
+inline void json_escape_to(std::string& out, std::string_view s) {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    const char* p = s.data();
+    const char* const end = p + s.size();
+    while (p < end) {
+        const char* q = json_find_escape(p, end);
+        out.append(p, static_cast<std::size_t>(q - p));
+        if (q == end) break;
+        const auto c = static_cast<unsigned char>(*q);
+        switch (c) {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            default: {
+                const char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out.append(u, sizeof(u));
+            }
+        }
+        p = q + 1;
+    }
+}
+
+} // namespace detail
+
+inline std::string json_escape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size() + 16);
+    detail::json_escape_to(out, s);
+    return out;
+}
+
+// =========================== Pattern Compiler ===========================
+// Patterns are compiled once (on set_pattern) into a flat token program. Rendering then
+// walks the program and appends straight into the caller's buffer, computing only the
+// fields the pattern actually references.
+
+namespace detail {
+
+enum class pattern_field : std::uint8_t { literal, ts, date, time, ms, us, ns, lvl, tid, name, msg, file, line, func };
+
+struct pattern_token {
+    pattern_field field = pattern_field::literal;
+    std::string text; // literal text (only for pattern_field::literal)
+};
+
+inline constexpr std::optional<pattern_field> pattern_field_of(std::string_view key) noexcept {
+    if (key == "ts") return pattern_field::ts;
+    if (key == "date") return pattern_field::date;
+    if (key == "time") return pattern_field::time;
+    if (key == "ms") return pattern_field::ms;
+    if (key == "us") return pattern_field::us;
+    if (key == "ns") return pattern_field::ns;
+    if (key == "lvl") return pattern_field::lvl;
+    if (key == "tid") return pattern_field::tid;
+    if (key == "name") return pattern_field::name;
+    if (key == "msg") return pattern_field::msg;
+    if (key == "file") return pattern_field::file;
+    if (key == "line") return pattern_field::line;
+    if (key == "func") return pattern_field::func;
+    return std::nullopt;
+}
+
+inline std::vector<pattern_token> compile_pattern(std::string_view pat) {
+    std::vector<pattern_token> prog;
+    auto add_literal = [&](std::string_view lit) {
+        if (lit.empty()) return;
+        if (!prog.empty() && prog.back().field == pattern_field::literal) {
+            prog.back().text.append(lit);
         } else {
-            if (file_.is_open()) file_.flush();
+            prog.push_back(pattern_token{pattern_field::literal, std::string(lit)});
+        }
+    };
+
+    std::size_t pos = 0;
+    while (pos < pat.size()) {
+        const std::size_t open = pat.find('{', pos);
+        if (open == std::string_view::npos) break;
+        const std::size_t close = pat.find('}', open + 1);
+        if (close == std::string_view::npos) break;
+
+        // Unknown tokens (e.g. "{foo}") are kept verbatim, as before. Only the '{' is
+        // consumed so that a nested token like "{{msg}}" still expands.
+        const auto f = pattern_field_of(pat.substr(open + 1, close - open - 1));
+        if (!f) {
+            add_literal(pat.substr(pos, open + 1 - pos));
+            pos = open + 1;
+            continue;
+        }
+        add_literal(pat.substr(pos, open - pos));
+        prog.push_back(pattern_token{*f, {}});
+        pos = close + 1;
+    }
+    add_literal(pat.substr(pos));
+    return prog;
+}
+
+template <class Int>
+inline void append_int(std::string& out, Int v) {
+    char buf[24];
+    const auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+inline void append_padded(std::string& out, unsigned v, int width) {
+    char buf[16];
+    write_padded(buf, v, width);
+    out.append(buf, static_cast<std::size_t>(width));
+}
+
+} // namespace detail
+
+// =========================== Buffered File Writer ===========================
+// Low-level file output shared by the built-in file sinks: a raw fd plus a user-space
+// buffer, instead of std::ofstream. Lines are rendered straight into the buffer; the
+// buffer is written with a single write() once it reaches buffer_size (or on flush(),
+// or when flush_interval has elapsed). Chunks larger than the buffer go out together with
+// the pending buffer in one writev() without being copied.
+//
+// With file_writer_options::io_uring (Linux, CHLOG_USE_IO_URING) full buffers are instead queued
+// to an io_uring and the caller goes straight back to filling the next one; a small pool of
+// buffers is recycled as writes complete, which bounds memory. flush() then only submits;
+// close() and sync_on_flush wait for the writes to land. Files are written at explicit offsets
+// rather than with O_APPEND, so they should have a single writer.
+
+struct file_writer_options {
+    std::size_t buffer_size = 64 * 1024;     // 0 => write every line immediately
+    std::chrono::milliseconds flush_interval{0}; // 0 => only size-based / explicit flushes
+    bool sync_on_flush = false;              // fdatasync (FlushFileBuffers-like on Windows) on flush()
+    bool io_uring = false;                   // needs CHLOG_USE_IO_URING on Linux; falls back to writev() otherwise
+    unsigned io_uring_depth = 4;             // buffers in flight before append() waits for a completion
+};
+
+namespace detail {
+
+#if defined(CHLOG_IO_URING)
+// Minimal io_uring driver for file_writer (raw syscalls, no liburing). Each filled buffer is
+// queued as one write at an explicit file offset, so completions may arrive in any order and
+// the file still ends up in order. A fixed set of buffers cycles between the writer and the
+// kernel, registered up front so the kernel can skip per-write page pinning; append() only
+// waits when every buffer is in flight. A write the kernel fails for good is redone with pwrite(),
+// and if io_uring_enter itself fails the writer stops using the ring and writes synchronously.
+class uring_writer {
+public:
+    uring_writer(unsigned depth, std::size_t buffer_size) : slots_(std::max(depth, 1u)) {
+        ::io_uring_params p{};
+        const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(slots_.size()), &p));
+        if (fd < 0) return;
+        ring_fd_ = fd;
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(::io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+        sq_ = map(sq_len_, IORING_OFF_SQ_RING);
+        cq_ = single ? sq_ : map(cq_len_, IORING_OFF_CQ_RING);
+        sqes_len_ = p.sq_entries * sizeof(::io_uring_sqe);
+        sqes_ = static_cast<::io_uring_sqe*>(map(sqes_len_, IORING_OFF_SQES));
+        if (!sq_ || !cq_ || !sqes_) {
+            release();
+            return;
+        }
+        auto* sq = static_cast<char*>(sq_);
+        auto* cq = static_cast<char*>(cq_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<::io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        // One spare buffer besides the in-flight slots: the one file_writer is filling. The
+        // headroom keeps the line that crosses buffer_size from reallocating (and so unregistering)
+        // the buffer.
+        const std::size_t cap = buffer_size + buffer_size / 4;
+        spare_.reserve(cap);
+        for (auto& s : slots_) s.data.reserve(cap);
+        std::vector<::iovec> iov;
+        iov.push_back({spare_.data(), spare_.capacity()});
+        for (auto& s : slots_) iov.push_back({s.data.data(), s.data.capacity()});
+        if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(iov.size())) == 0)
+            registered_ = std::move(iov);
+    }
+
+    ~uring_writer() {
+        wait_all();
+        release();
+    }
+
+    uring_writer(const uring_writer&) = delete;
+    uring_writer& operator=(const uring_writer&) = delete;
+
+    bool ok() const noexcept { return ring_fd_ >= 0; }
+
+    // The buffer to render into before the first submit().
+    std::string take_spare() { return std::move(spare_); }
+
+    // Queues `buf` for writing at `offset` of `fd` and hands back an empty buffer in its place
+    // (a recycled one, capacity kept). Waits for a completion only if all buffers are in flight.
+    void submit(int fd, std::string& buf, std::uint64_t offset) {
+        slot* s = nullptr;
+        while (!broken_ && !(s = free_slot())) wait_one();
+        if (broken_) {
+            write_sync(fd, buf.data(), buf.size(), offset);
+            buf.clear();
+            return;
+        }
+        s->data.swap(buf);
+        buf.clear();
+        s->fd = fd;
+        s->offset = offset;
+        s->done = 0;
+        s->busy = true;
+        ++inflight_;
+        queue(*s);
+        kick(0);
+    }
+
+    // Returns once every queued write has completed (or failed).
+    void wait_all() {
+        while (inflight_ > 0) wait_one();
+    }
+
+private:
+    struct slot {
+        std::string data;
+        int fd = -1;
+        std::uint64_t offset = 0;
+        std::size_t done = 0; // bytes already written (short writes are resubmitted)
+        bool busy = false;
+    };
+
+    void* map(std::size_t len, std::uint64_t off) const {
+        void* p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, static_cast<::off_t>(off));
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    void release() noexcept {
+        if (sqes_) ::munmap(sqes_, sqes_len_);
+        if (cq_ && cq_ != sq_) ::munmap(cq_, cq_len_);
+        if (sq_) ::munmap(sq_, sq_len_);
+        sqes_ = nullptr;
+        sq_ = cq_ = nullptr;
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+        ring_fd_ = -1;
+    }
+
+    slot* free_slot() {
+        reap();
+        for (auto& s : slots_) {
+            if (!s.busy) return &s;
+        }
+        return nullptr;
+    }
+
+    // Index of the registered buffer holding `data`, or -1 (it grew and was reallocated).
+    int registered_index(const std::string& data) const noexcept {
+        for (std::size_t i = 0; i < registered_.size(); ++i) {
+            const char* base = static_cast<const char*>(registered_[i].iov_base);
+            if (data.data() == base && data.size() <= registered_[i].iov_len) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Writes the SQE for the rest of `s`. At most slots_.size() writes are outstanding and the
+    // kernel consumes SQEs on every io_uring_enter, so the submission ring never overflows.
+    void queue(slot& s) {
+        const unsigned tail = *sq_tail_;
+        const unsigned idx = tail & sq_mask_;
+        ::io_uring_sqe& e = sqes_[idx];
+        std::memset(&e, 0, sizeof(e));
+        const int reg = s.done == 0 ? registered_index(s.data) : -1;
+        e.opcode = reg >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        e.fd = s.fd;
+        e.addr = reinterpret_cast<std::uint64_t>(s.data.data() + s.done);
+        e.len = static_cast<std::uint32_t>(std::min<std::size_t>(s.data.size() - s.done, 1u << 30));
+        e.off = s.offset + s.done;
+        if (reg >= 0) e.buf_index = static_cast<std::uint16_t>(reg);
+        e.user_data = static_cast<std::uint64_t>(&s - slots_.data());
+        sq_array_[idx] = idx;
+        std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+        ++unsubmitted_;
+    }
+
+    // Submits the queued SQEs and, with `min_complete`, waits for that many completions. The
+    // kernel may take fewer SQEs than offered, or refuse for now (EAGAIN, EBUSY while the CQ ring
+    // is full), so completions are reaped and the call retried; any other error gives up on the
+    // ring (fail()).
+    void kick(unsigned min_complete) {
+        const unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0u;
+        if (unsubmitted_ == 0 && min_complete == 0) return;
+        for (int busy = 0; !broken_;) {
+            const long r = ::syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, min_complete, flags, nullptr, 0);
+            if (r >= 0) {
+                unsubmitted_ -= std::min(static_cast<unsigned>(r), unsubmitted_);
+                if (unsubmitted_ == 0) return;
+                if (r > 0) continue; // took some: offer the rest
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EBUSY) {
+                fail();
+                return;
+            }
+            if (++busy > 1000) {
+                fail();
+                return;
+            }
+            process_completions();
+            std::this_thread::yield();
+        }
+    }
+
+    void wait_one() {
+        if (reap() > 0 || broken_) return;
+        kick(1);
+        reap();
+    }
+
+    // Processes completions and submits any resubmitted writes; returns how many buffers were freed.
+    unsigned reap() {
+        const unsigned freed = process_completions();
+        if (unsubmitted_ > 0) kick(0);
+        return freed;
+    }
+
+    unsigned process_completions() {
+        unsigned freed = 0;
+        unsigned head = *cq_head_;
+        const unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const ::io_uring_cqe& c = cqes_[head & cq_mask_];
+            slot& s = slots_[static_cast<std::size_t>(c.user_data)];
+            if (c.res > 0) s.done += static_cast<std::size_t>(c.res);
+            const bool retry = c.res == -EINTR || c.res == -EAGAIN;
+            if ((c.res > 0 && s.done < s.data.size()) || retry) {
+                queue(s);
+                continue;
+            }
+            // Failed for good (or wrote nothing): write the rest synchronously, so the offsets
+            // already handed out never leave a hole in the file.
+            if (s.done < s.data.size()) write_sync(s.fd, s.data.data() + s.done, s.data.size() - s.done, s.offset + s.done);
+            s.busy = false;
+            s.data.clear();
+            --inflight_;
+            ++freed;
+        }
+        std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+        return freed;
+    }
+
+    // io_uring_enter failed for good: write every in-flight buffer with pwrite() (rewriting the
+    // same bytes at the same offset is harmless if the kernel did complete some of them) and
+    // bypass the ring from now on. The slot buffers are left alone, as the kernel may still read
+    // them.
+    void fail() {
+        broken_ = true;
+        for (auto& s : slots_) {
+            if (!s.busy) continue;
+            write_sync(s.fd, s.data.data() + s.done, s.data.size() - s.done, s.offset + s.done);
+            s.busy = false;
+        }
+        inflight_ = 0;
+        unsubmitted_ = 0;
+    }
+
+    // Drops what can't be written; logging must not throw.
+    static void write_sync(int fd, const char* p, std::size_t n, std::uint64_t offset) noexcept {
+        while (n > 0) {
+            const ::ssize_t w = ::pwrite(fd, p, n, static_cast<::off_t>(offset));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+            offset += static_cast<std::uint64_t>(w);
+        }
+    }
+
+    std::vector<slot> slots_;
+    std::string spare_;
+    std::vector<::iovec> registered_;
+    std::size_t inflight_ = 0;
+    unsigned unsubmitted_ = 0; // SQEs queued but not yet taken by the kernel
+    bool broken_ = false;      // io_uring_enter failed: every write goes through pwrite()
+
+    int ring_fd_ = -1;
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    ::io_uring_sqe* sqes_ = nullptr;
+    std::size_t sq_len_ = 0;
+    std::size_t cq_len_ = 0;
+    std::size_t sqes_len_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    ::io_uring_cqe* cqes_ = nullptr;
+};
+#endif
+
+
+class file_writer {
+public:
+    explicit file_writer(file_writer_options opts = {}) : opts_(opts) {
+#if defined(CHLOG_IO_URING)
+        if (opts_.io_uring && opts_.buffer_size > 0) {
+            auto ring = std::make_unique<uring_writer>(opts_.io_uring_depth, opts_.buffer_size);
+            if (ring->ok()) {
+                buf_ = ring->take_spare();
+                uring_ = std::move(ring);
+                return;
+            }
+        }
+#endif
+        buf_.reserve(opts_.buffer_size);
+    }
+    ~file_writer() { close(); }
+
+    file_writer(const file_writer&) = delete;
+    file_writer& operator=(const file_writer&) = delete;
+
+    bool open(const std::filesystem::path& path) {
+        close();
+#ifdef _WIN32
+        fd_ = ::_wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#elif defined(CHLOG_IO_URING)
+        if (uring_) {
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            const ::off_t end = fd_ >= 0 ? ::lseek(fd_, 0, SEEK_END) : 0;
+            offset_ = end > 0 ? static_cast<std::uint64_t>(end) : 0;
+        } else {
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+        if (opts_.flush_interval.count() > 0) last_flush_ = std::chrono::steady_clock::now();
+        return fd_ >= 0;
+    }
+
+    bool is_open() const noexcept { return fd_ >= 0; }
+
+    void close() {
+        if (fd_ < 0) return;
+        flush();
+#if defined(CHLOG_IO_URING)
+        if (uring_) uring_->wait_all();
+#endif
+#ifdef _WIN32
+        ::_close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+
+    // Appends directly into the write buffer via fn(std::string&); returns the bytes appended.
+    template <class Fn>
+    std::size_t append(Fn&& fn) {
+        if (fd_ < 0) return 0;
+        const std::size_t before = buf_.size();
+        fn(buf_);
+        const std::size_t n = buf_.size() - before;
+        if (buf_.size() >= opts_.buffer_size) {
+            write_out(std::string_view{});
+        } else if (opts_.flush_interval.count() > 0 && std::chrono::steady_clock::now() - last_flush_ >= opts_.flush_interval) {
+            write_out(std::string_view{});
+        }
+        return n;
+    }
+
+    // Appends an already rendered chunk. Chunks larger than the buffer are not copied.
+    void write(std::string_view data) {
+        if (fd_ < 0) return;
+        if (data.size() >= opts_.buffer_size) {
+            write_out(data);
+            return;
+        }
+        append([&](std::string& out) { out.append(data); });
+    }
+
+    void flush() {
+        if (fd_ < 0) return;
+        write_out(std::string_view{});
+        if (opts_.sync_on_flush) {
+#if defined(CHLOG_IO_URING)
+            if (uring_) uring_->wait_all();
+#endif
+#ifdef _WIN32
+            ::_commit(fd_);
+#elif defined(__APPLE__)
+            ::fsync(fd_);
+#else
+            ::fdatasync(fd_);
+#endif
+        }
+    }
+
+    // Crash handler only: writes the pending buffer with plain write(2), which is async-signal-safe.
+    // io_uring writes still in flight are waited for first; they would be cancelled at exit.
+    void crash_write() noexcept {
+#ifndef _WIN32
+    #if defined(CHLOG_IO_URING)
+        if (uring_) uring_->wait_all();
+    #endif
+        const char* p = buf_.data();
+        std::size_t n = buf_.size();
+        while (fd_ >= 0 && n > 0) {
+    #if defined(CHLOG_IO_URING)
+            const ::ssize_t w = uring_ ? ::pwrite(fd_, p, n, static_cast<::off_t>(offset_)) : ::write(fd_, p, n);
+            if (uring_ && w > 0) offset_ += static_cast<std::uint64_t>(w);
+    #else
+            const ::ssize_t w = ::write(fd_, p, n);
+    #endif
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        buf_.clear();
+#endif
+    }
+
+private:
+    // Writes the pending buffer followed by `extra` (gathered into one syscall where possible).
+    void write_out(std::string_view extra) {
+        if (opts_.flush_interval.count() > 0) last_flush_ = std::chrono::steady_clock::now();
+        if (buf_.empty() && extra.empty()) return;
+#if defined(CHLOG_IO_URING)
+        if (uring_) {
+            // The buffer is handed to the kernel, so `extra` has to be copied in.
+            buf_.append(extra);
+            const std::size_t n = buf_.size();
+            uring_->submit(fd_, buf_, offset_);
+            offset_ += n;
+            return;
+        }
+#endif
+#ifdef _WIN32
+        write_all(buf_.data(), buf_.size());
+        write_all(extra.data(), extra.size());
+#else
+        ::iovec iov[2];
+        int cnt = 0;
+        if (!buf_.empty()) iov[cnt++] = {buf_.data(), buf_.size()};
+        if (!extra.empty()) iov[cnt++] = {const_cast<char*>(extra.data()), extra.size()};
+        ::iovec* v = iov;
+        while (cnt > 0) {
+            const ::ssize_t w = ::writev(fd_, v, cnt);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                break; // drop on I/O error; logging must not throw
+            }
+            std::size_t done = static_cast<std::size_t>(w);
+            while (cnt > 0 && done >= v->iov_len) {
+                done -= v->iov_len;
+                ++v;
+                --cnt;
+            }
+            if (cnt > 0) {
+                v->iov_base = static_cast<char*>(v->iov_base) + done;
+                v->iov_len -= done;
+            }
+        }
+#endif
+        buf_.clear();
+    }
+
+#ifdef _WIN32
+    void write_all(const char* p, std::size_t n) {
+        while (n > 0) {
+            const unsigned chunk = static_cast<unsigned>(std::min<std::size_t>(n, 1u << 30));
+            const int w = ::_write(fd_, p, chunk);
+            if (w <= 0) return;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+    }
+#endif
+
+    file_writer_options opts_;
+    int fd_ = -1;
+    std::string buf_;
+    std::chrono::steady_clock::time_point last_flush_{};
+#if defined(CHLOG_IO_URING)
+    std::unique_ptr<uring_writer> uring_;
+    std::uint64_t offset_ = 0; // next write position (io_uring writes are positional)
+#endif
+};
+
+} // namespace detail
+
+// =========================== Sink Interface ===========================
+
+namespace detail {
+// Bumped by sink::set_level; loggers use it to notice that their cached lowest sink threshold
+// (the pre-format filter) may be stale.
+inline std::atomic<std::uint64_t> sink_levels_changed{0};
+
+// Shortest round-trip form, as std::format("{}") prints it.
+inline void append_double(std::string& out, double v) {
+    char buf[32];
+    const auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+// Text form of structured fields: " key=value" per field, appended after the message. Strings
+// are quoted (JSON escapes) when empty or when they contain spaces, quotes, '=' or controls.
+inline void append_fields_text(std::string& out, const log_event& e) {
+    for (const field_view& f : e.fields()) {
+        out.push_back(' ');
+        out.append(f.key);
+        out.push_back('=');
+        switch (f.type) {
+            case field_type::i64: append_int(out, f.i64); break;
+            case field_type::u64: append_int(out, f.u64); break;
+            case field_type::f64: append_double(out, f.f64); break;
+            case field_type::boolean: out.append(f.boolean ? "true" : "false"); break;
+            case field_type::str: {
+                const bool quote = f.str.empty() || std::any_of(f.str.begin(), f.str.end(), [](char c) {
+                    return static_cast<unsigned char>(c) <= ' ' || c == '"' || c == '=';
+                });
+                if (!quote) {
+                    out.append(f.str);
+                    break;
+                }
+                out.push_back('"');
+                json_escape_to(out, f.str);
+                out.push_back('"');
+                break;
+            }
+        }
+    }
+}
+
+// JSON form: one member per field, placed after "msg" (keys are written as given, so they
+// should not repeat the built-in ones). Non-finite doubles become null.
+inline void append_fields_json(std::string& out, const log_event& e) {
+    for (const field_view& f : e.fields()) {
+        out.append(",\"");
+        json_escape_to(out, f.key);
+        out.append("\":");
+        switch (f.type) {
+            case field_type::i64: append_int(out, f.i64); break;
+            case field_type::u64: append_int(out, f.u64); break;
+            case field_type::f64:
+                if (std::isfinite(f.f64)) append_double(out, f.f64);
+                else out.append("null");
+                break;
+            case field_type::boolean: out.append(f.boolean ? "true" : "false"); break;
+            case field_type::str:
+                out.push_back('"');
+                json_escape_to(out, f.str);
+                out.push_back('"');
+                break;
+        }
+    }
+}
+
+// {msg}: the message, then any structured fields.
+inline void append_message(std::string& out, const log_event& e) {
+    out.append(e.message());
+    if (e.has_fields()) append_fields_text(out, e);
+}
+
+// The "{json}" pattern: one JSON object per event.
+inline void render_json_to(std::string& out, const log_event& e) {
+    out.append(R"({"ts":")");
+    detail::append_timestamp(out, e.ts);
+    out.append(R"(","lvl":")");
+    out.append(level_name(e.lvl));
+    out.append(R"(","tid":")");
+    detail::append_thread_id(out, e.tid);
+    out.append(R"(","name":")");
+    detail::json_escape_to(out, e.name);
+    out.append(R"(","seq":)");
+    detail::append_int(out, e.seq);
+    out.append(R"(,"file":")");
+    detail::json_escape_to(out, e.file());
+    out.append(R"(","line":)");
+    detail::append_int(out, e.line());
+    out.append(R"(,"func":")");
+    detail::json_escape_to(out, e.func());
+    out.append(R"(","msg":")");
+    detail::json_escape_to(out, e.message());
+    out.push_back('"');
+    if (e.has_fields()) append_fields_json(out, e);
+    out.push_back('}');
+}
+} // namespace detail
+
+class sink {
+public:
+    virtual ~sink() = default;
+    virtual void set_pattern(std::string pat) {
+        pattern_ = std::move(pat);
+        json_ = (pattern_ == "{json}");
+        program_ = detail::compile_pattern(pattern_);
+    }
+    virtual void set_level(level lv) {
+        level_ = lv;
+        detail::sink_levels_changed.fetch_add(1, std::memory_order_release);
+    }
+    virtual void set_thread_safe(bool enabled) noexcept { thread_safe_ = enabled; }
+    virtual level level_threshold() const { return level_; }
+
+    // Opt-in for the loggers' pre-format filter: return true only if level_threshold() changes
+    // solely through sink::set_level (which bumps the generation the loggers' cached floor is
+    // checked against). Sinks that keep the default count as accepting every level, so a
+    // threshold computed on the fly is always honoured; the built-in sinks opt in.
+    virtual bool static_level() const noexcept { return false; }
+    virtual void log(const log_event& e) = 0;
+
+    // Writes a batch of events (async worker). The default forwards to log() per event,
+    // honouring level_threshold(); built-in sinks override it to take their lock once and
+    // render the whole batch into one buffer.
+    virtual void log_batch(std::span<const log_event> events) {
+        for (const auto& e : events) {
+            if (static_cast<int>(e.lvl) < static_cast<int>(level_threshold())) continue;
+            try {
+                log(e);
+            } catch (...) {
+            }
+        }
+    }
+
+    virtual void flush() {}
+
+    // Sinks returning true may receive events whose payload still holds encoded arguments
+    // (log_event::deferred != nullptr). The async worker only skips formatting when every
+    // attached sink accepts them.
+    virtual bool accepts_deferred() const noexcept { return false; }
+
+    // Called by the crash handler (install_crash_handler) in signal context, after the async drain:
+    // hand buffered output to the OS using only async-signal-safe calls, or do nothing.
+    virtual void crash_flush() noexcept {}
+
+    // Sinks that ship somewhere fill `out` and return true; logger::stats() collects them.
+    virtual bool report(sink_stats& out) const {
+        (void)out;
+        return false;
+    }
+
+protected:
+    std::string pattern_ = "[{date} {time}.{ms}][{lvl}][{name}] {msg}";
+    level level_ = level::trace;
+    bool thread_safe_ = true;
+    bool json_ = false;
+    std::vector<detail::pattern_token> program_ = detail::compile_pattern(pattern_);
+
+    std::string render(const log_event& e) const {
+        std::string out;
+        render_to(out, e);
+        return out;
+    }
+
+    // Appends the rendered line (without trailing newline) to `out`.
+    void render_to(std::string& out, const log_event& e) const {
+        if (json_) {
+            render_json_to(out, e);
+            return;
+        }
+
+        for (const auto& t : program_) {
+            switch (t.field) {
+                case detail::pattern_field::literal: out.append(t.text); break;
+                case detail::pattern_field::ts: detail::append_timestamp(out, e.ts); break;
+                case detail::pattern_field::date: out.append(detail::cached_time(e.ts).date()); break;
+                case detail::pattern_field::time: out.append(detail::cached_time(e.ts).time()); break;
+                case detail::pattern_field::ms: detail::append_padded(out, detail::subsecond<std::milli>(e.ts), 3); break;
+                case detail::pattern_field::us: detail::append_padded(out, detail::subsecond<std::micro>(e.ts), 6); break;
+                case detail::pattern_field::ns: detail::append_padded(out, detail::subsecond<std::nano>(e.ts), 9); break;
+                case detail::pattern_field::lvl: out.append(level_name(e.lvl)); break;
+                case detail::pattern_field::tid: detail::append_thread_id(out, e.tid); break;
+                case detail::pattern_field::name: out.append(e.name); break;
+                case detail::pattern_field::msg: detail::append_message(out, e); break;
+                case detail::pattern_field::file: out.append(e.file()); break;
+                case detail::pattern_field::line: detail::append_int(out, e.line()); break;
+                case detail::pattern_field::func: out.append(e.func()); break;
+            }
+        }
+    }
+
+    static void render_json_to(std::string& out, const log_event& e) { detail::render_json_to(out, e); }
+};
+
+class console_sink : public sink {
+public:
+    enum class style { plain, color };
+    explicit console_sink(style s = style::plain) : style_(s) {}
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            write_lines(std::span<const log_event>(&e, 1));
+        } else {
+            write_lines(std::span<const log_event>(&e, 1));
+        }
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            write_lines(events);
+        } else {
+            write_lines(events);
+        }
+    }
+
+    void flush() override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            std::cout << std::flush;
+        } else {
+            std::cout << std::flush;
+        }
+    }
+
+private:
+    void write_lines(std::span<const log_event> events) {
+        buf_.clear();
+        for (const auto& e : events) {
+            if (static_cast<int>(e.lvl) < static_cast<int>(level_)) continue;
+            if (style_ == style::color) buf_.append(color_of(e.lvl));
+            render_to(buf_, e);
+            if (style_ == style::color) buf_.append("\x1b[0m");
+            buf_.push_back('\n');
+        }
+        if (!buf_.empty()) std::cout.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    }
+
+    static const char* color_of(level lv) noexcept {
+        switch (lv) {
+            case level::trace: return "\x1b[37m";
+            case level::debug: return "\x1b[36m";
+            case level::info: return "\x1b[32m";
+            case level::warn: return "\x1b[33m";
+            case level::error: return "\x1b[31m";
+            case level::critical: return "\x1b[1;31m";
+            case level::off: return "\x1b[0m";
+        }
+        return "\x1b[0m";
+    }
+
+    style style_;
+    std::string buf_;
+    std::mutex m_;
+};
+
+// Rotation housekeeping. rotate() on the sinks only moves the active file aside (one rename to
+// a staging name, "<path>.rotating.<pid>.<n>") and reopens; shifting path.1..path.N, pruning,
+// and compression of the staged file run afterwards, on a helper thread by default. Staged files
+// a previous run left behind are picked up when the sink is created.
+struct rotation_options {
+    enum class compression { none, gzip };
+
+    bool background = true;                  // false => do the housekeeping inline in rotate()
+    compression compress = compression::none; // gzip requires CHLOG_USE_ZLIB (ignored otherwise)
+};
+
+namespace detail {
+
+class rotation_worker {
+public:
+    rotation_worker(std::filesystem::path path, std::size_t max_files, rotation_options opts)
+        : path_(std::move(path)), max_files_(max_files ? max_files : 1), opts_(opts) {
+#if !defined(CHLOG_USE_ZLIB)
+        opts_.compress = rotation_options::compression::none;
+#endif
+        recover();
+    }
+
+    ~rotation_worker() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable()) thread_.join(); // finishes pending work first
+    }
+
+    rotation_worker(const rotation_worker&) = delete;
+    rotation_worker& operator=(const rotation_worker&) = delete;
+
+    // A staging name no file uses yet; unique across processes sharing the directory.
+    std::filesystem::path staging_name() {
+        std::error_code ec;
+        for (;;) {
+            std::filesystem::path p = path_.string() + ".rotating." + std::to_string(process_id()) + "." +
+                                      std::to_string(++staged_count_);
+            if (!std::filesystem::exists(p, ec)) return p;
+        }
+    }
+
+    // Renames the active file to a unique staging name; returns it (empty on failure).
+    std::filesystem::path stage() {
+        std::error_code ec;
+        if (!std::filesystem::exists(path_, ec)) return {};
+        std::filesystem::path staged = staging_name();
+        std::filesystem::rename(path_, staged, ec);
+        return ec ? std::filesystem::path{} : staged;
+    }
+
+    // Hands a staged file over for shifting/pruning/compression.
+    void submit(std::filesystem::path staged) {
+        if (staged.empty()) return;
+        if (!opts_.background) {
+            process(staged);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            pending_.push_back(std::move(staged));
+            if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+        }
+        cv_.notify_one();
+    }
+
+private:
+    static long process_id() noexcept {
+#ifdef _WIN32
+        return static_cast<long>(::_getpid());
+#else
+        return static_cast<long>(::getpid());
+#endif
+    }
+
+    // Staged files left by a run that stopped before their housekeeping are rotated in first,
+    // oldest first. Empty ones (unused spare files) are removed.
+    void recover() {
+        namespace fs = std::filesystem;
+        const fs::path dir = path_.has_parent_path() ? path_.parent_path() : fs::path(".");
+        const std::string prefix = path_.filename().string() + ".rotating.";
+        std::vector<std::pair<fs::file_time_type, fs::path>> found;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            const std::string name = it->path().filename().string();
+            if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+            std::error_code fec;
+            if (!it->is_regular_file(fec)) continue;
+            if (it->file_size(fec) == 0 && !fec) {
+                fs::remove(it->path(), fec);
+                continue;
+            }
+            found.emplace_back(it->last_write_time(fec), it->path());
+        }
+        std::sort(found.begin(), found.end());
+        for (auto& f : found) submit(std::move(f.second));
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lk(m_);
+        for (;;) {
+            cv_.wait(lk, [&] { return stop_ || !pending_.empty(); });
+            if (pending_.empty()) return; // stop_ and drained
+            auto staged = std::move(pending_.front());
+            pending_.pop_front();
+            lk.unlock();
+            try {
+                process(staged);
+            } catch (...) {
+            }
+            lk.lock();
+        }
+    }
+
+    std::string backup_name(std::size_t i) const {
+        std::string name = path_.string() + "." + std::to_string(i);
+        if (opts_.compress == rotation_options::compression::gzip) name += ".gz";
+        return name;
+    }
+
+    void process(const std::filesystem::path& staged) {
+        std::error_code ec;
+        // Remove the last one to make space.
+        const auto last = backup_name(max_files_);
+        if (std::filesystem::exists(last, ec)) {
+            std::filesystem::remove(last, ec);
+        }
+
+        for (std::size_t i = max_files_ - 1; i >= 1; --i) {
+            const auto src = backup_name(i);
+            if (std::filesystem::exists(src, ec)) {
+                std::filesystem::rename(src, backup_name(i + 1), ec);
+            }
+            if (i == 1) break;
+        }
+
+        const auto first = backup_name(1);
+        if (opts_.compress == rotation_options::compression::gzip && gzip_file(staged, first)) {
+            std::filesystem::remove(staged, ec);
+        } else {
+            std::filesystem::rename(staged, first, ec);
+        }
+    }
+
+    static bool gzip_file(const std::filesystem::path& src, const std::filesystem::path& dst) {
+#if defined(CHLOG_USE_ZLIB)
+        const std::string tmp = dst.string() + ".tmp";
+        std::FILE* in = std::fopen(src.string().c_str(), "rb");
+        if (!in) return false;
+        gzFile out = ::gzopen(tmp.c_str(), "wb6");
+        bool ok = out != nullptr;
+        std::vector<char> buf(64 * 1024);
+        while (ok) {
+            const std::size_t n = std::fread(buf.data(), 1, buf.size(), in);
+            if (n == 0) break;
+            ok = ::gzwrite(out, buf.data(), static_cast<unsigned>(n)) == static_cast<int>(n);
+        }
+        std::fclose(in);
+        if (out && ::gzclose(out) != Z_OK) ok = false;
+        std::error_code ec;
+        if (ok) std::filesystem::rename(tmp, dst, ec);
+        if (!ok || ec) {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+#else
+        (void)src;
+        (void)dst;
+        return false;
+#endif
+    }
+
+    std::filesystem::path path_;
+    std::size_t max_files_;
+    rotation_options opts_;
+    std::uint64_t staged_count_ = 0;
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<std::filesystem::path> pending_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace detail
+
+// rotate() swaps the active writer for a spare one that is already open on a staging name, so
+// the sink lock is only held for a pointer swap. The thread that swapped then, outside the lock,
+// retires the old file (rename to a staging name, close) and gives the spare its real name via
+// rename; the open descriptor keeps writing across it. It also opens the next spare. rotate()
+// falls back to closing and reopening inline when no spare is ready (always on Windows, where
+// an open file can't be renamed).
+class rotating_file_sink : public sink {
+public:
+    rotating_file_sink(std::filesystem::path path, std::size_t max_bytes, std::size_t max_files,
+                       file_writer_options opts = {}, rotation_options rot = {})
+        : path_(std::move(path)), max_bytes_(max_bytes), opts_(opts), file_(std::make_unique<detail::file_writer>(opts)),
+          rotation_(path_, max_files, rot) {
+        if (!path_.parent_path().empty()) {
+            std::filesystem::create_directories(path_.parent_path());
+        }
+        open();
+        spare_ = open_spare(spare_path_);
+    }
+
+    ~rotating_file_sink() override { drop_spare(std::move(spare_), spare_path_); }
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        bool swapped = false;
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            swapped = write_line(e);
+        } else {
+            swapped = write_line(e);
+        }
+        if (swapped) finish_rotation();
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        bool swapped = false;
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) swapped |= write_line(e);
+            }
+        } else {
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) swapped |= write_line(e);
+            }
+        }
+        if (swapped) finish_rotation();
+    }
+
+    void flush() override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            if (file_->is_open()) file_->flush();
+        } else {
+            if (file_->is_open()) file_->flush();
+        }
+    }
+
+    // Skipped if a writer holds the lock: its buffer may be half-updated.
+    void crash_flush() noexcept override {
+        std::unique_lock<std::mutex> lk(m_, std::try_to_lock);
+        if (lk.owns_lock() || !thread_safe_) file_->crash_write();
+    }
+
+private:
+    // Returns true if it swapped in the spare; the caller then calls finish_rotation() unlocked.
+    bool write_line(const log_event& e) {
+        if (!file_->is_open()) return false;
+        bytes_ += file_->append([&](std::string& out) {
+            render_to(out, e);
+            out.push_back('\n');
+        });
+        // While a rotation is being finished the file just runs past max_bytes.
+        if (bytes_ < max_bytes_ || rotating_) return false;
+        if (!spare_) {
+            rotate();
+            return false;
+        }
+        retired_ = std::move(file_);
+        file_ = std::move(spare_);
+        live_path_ = std::move(spare_path_);
+        bytes_ = 0;
+        rotating_ = true;
+        return true;
+    }
+
+    void open() {
+        file_->open(path_);
+        std::error_code ec;
+        bytes_ = std::filesystem::exists(path_, ec) ? static_cast<std::size_t>(std::filesystem::file_size(path_, ec)) : 0;
+        if (ec) bytes_ = 0;
+    }
+
+    // Inline fallback: closes, moves the file aside and reopens under the lock.
+    void rotate() {
+        file_->close();
+        auto staged = rotation_.stage();
+        open();
+        rotation_.submit(std::move(staged));
+        if (!spare_) spare_ = open_spare(spare_path_);
+    }
+
+    // Runs on the thread that swapped, without the sink lock: nobody else touches retired_,
+    // live_path_ or rotation_ until rotating_ is cleared.
+    void finish_rotation() {
+        retired_->close();
+        retired_.reset();
+        auto staged = rotation_.stage();
+        std::error_code ec;
+        // If the old file could not be moved aside the live one keeps its staging name; it is
+        // picked up as a rotated file next time the sink is created.
+        if (!std::filesystem::exists(path_, ec)) std::filesystem::rename(live_path_, path_, ec);
+        rotation_.submit(std::move(staged));
+
+        std::filesystem::path next_path;
+        auto next = open_spare(next_path);
+        std::unique_lock<std::mutex> lk(m_, std::defer_lock);
+        if (thread_safe_) lk.lock();
+        spare_ = std::move(next);
+        spare_path_ = std::move(next_path);
+        rotating_ = false;
+    }
+
+    std::unique_ptr<detail::file_writer> open_spare(std::filesystem::path& where) {
+#ifdef _WIN32
+        (void)where;
+        return nullptr;
+#else
+        where = rotation_.staging_name();
+        auto w = std::make_unique<detail::file_writer>(opts_);
+        if (w->open(where)) return w;
+        where.clear();
+        return nullptr;
+#endif
+    }
+
+    static void drop_spare(std::unique_ptr<detail::file_writer> w, const std::filesystem::path& where) {
+        if (!w) return;
+        w->close();
+        std::error_code ec;
+        std::filesystem::remove(where, ec);
+    }
+
+    std::filesystem::path path_;
+    std::size_t max_bytes_{};
+    file_writer_options opts_;
+    std::unique_ptr<detail::file_writer> file_;
+    std::size_t bytes_ = 0;
+    std::mutex m_;
+    // Under m_: spare_/spare_path_ (ready for the next rotation) and rotating_.
+    std::unique_ptr<detail::file_writer> spare_;
+    std::filesystem::path spare_path_;
+    bool rotating_ = false;
+    std::unique_ptr<detail::file_writer> retired_; // owned by the finishing thread
+    std::filesystem::path live_path_;               // staging name the active file was opened under
+    detail::rotation_worker rotation_; // last: joins its thread before the members above go away
+};
+
+#ifndef _WIN32
+// Size-based rotation like rotating_file_sink, but each file is preallocated to max_bytes and
+// mapped into memory. Writers reserve space with one atomic fetch_add and memcpy the rendered
+// line into the mapping, so concurrent sync-mode producers never take a lock or make a syscall
+// on the write path. The writer whose reservation crosses the end of the file rotates: it
+// renames the files, maps a fresh one, publishes it, and trims the old file to the bytes
+// actually written once its last writer has left. Lines longer than max_bytes are truncated.
+//
+// Data lives in the page cache as soon as it is copied, so it survives a process crash; the
+// current file is zero-padded up to max_bytes until it is closed or rotated. If a file cannot be
+// mapped, lines are dropped and a writer retries with exponential backoff. POSIX only.
+class mmap_rotating_file_sink : public sink {
+public:
+    mmap_rotating_file_sink(std::filesystem::path path, std::size_t max_bytes, std::size_t max_files,
+                            bool sync_on_flush = false, rotation_options rot = {})
+        : path_(std::move(path)),
+          max_bytes_(std::max<std::size_t>(max_bytes, 4096)),
+          sync_on_flush_(sync_on_flush),
+          rotation_(path_, max_files, rot) {
+        if (!path_.parent_path().empty()) {
+            std::filesystem::create_directories(path_.parent_path());
+        }
+        segment* seg = take_header();
+        open_segment(*seg);
+        current_.store(seg, std::memory_order_release);
+    }
+
+    ~mmap_rotating_file_sink() override {
+        segment* s = current_.load(std::memory_order_acquire);
+        close_segment(*s, std::min(s->offset.load(std::memory_order_acquire), s->cap));
+    }
+
+    mmap_rotating_file_sink(const mmap_rotating_file_sink&) = delete;
+    mmap_rotating_file_sink& operator=(const mmap_rotating_file_sink&) = delete;
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        std::string& buf = scratch();
+        buf.clear();
+        render_to(buf, e);
+        buf.push_back('\n');
+        commit(buf);
+    }
+
+    // Renders the batch into one buffer and reserves space once per chunk.
+    void log_batch(std::span<const log_event> events) override {
+        const std::size_t chunk = std::min<std::size_t>(64 * 1024, max_bytes_);
+        std::string& buf = scratch();
+        buf.clear();
+        for (const auto& e : events) {
+            if (static_cast<int>(e.lvl) < static_cast<int>(level_)) continue;
+            const std::size_t before = buf.size();
+            render_to(buf, e);
+            buf.push_back('\n');
+            if (buf.size() > chunk && before > 0) {
+                commit(std::string_view(buf).substr(0, before));
+                buf.erase(0, before);
+            }
+        }
+        if (!buf.empty()) commit(buf);
+    }
+
+    void flush() override {
+        segment* s = acquire();
+        if (s->base) {
+            const std::size_t used = std::min(s->offset.load(std::memory_order_relaxed), s->cap);
+            if (used) ::msync(s->base, used, sync_on_flush_ ? MS_SYNC : MS_ASYNC);
+        }
+        release(s);
+    }
+
+private:
+    struct segment {
+        char* base = nullptr;
+        std::size_t cap = 0;
+        int fd = -1;
+        std::atomic<std::uint64_t> id{0}; // changes each time the header is reused
+        alignas(64) std::atomic<std::size_t> offset{0};
+        alignas(64) std::atomic<int> writers{0};
+    };
+
+    static constexpr std::chrono::milliseconds min_retry{10};
+    static constexpr std::chrono::milliseconds max_retry{1000};
+
+    static std::string& scratch() {
+        thread_local std::string buf;
+        return buf;
+    }
+
+    // Segment headers are recycled rather than freed: a writer holding a stale pointer may still
+    // touch `writers` and compare against current_, and a header only goes back to the pool once
+    // its file is closed and no writer is pinned on it.
+    segment* take_header() {
+        std::lock_guard<std::mutex> lk(headers_mu_);
+        segment* s;
+        if (!free_headers_.empty()) {
+            s = free_headers_.back();
+            free_headers_.pop_back();
+        } else {
+            s = headers_.emplace_back(std::make_unique<segment>()).get();
+        }
+        s->id.store(++header_uses_, std::memory_order_relaxed);
+        return s;
+    }
+
+    void put_header(segment* s) {
+        std::lock_guard<std::mutex> lk(headers_mu_);
+        free_headers_.push_back(s);
+    }
+
+    // (Re)initializes a header that is not current; leaves base null if the file can't be mapped.
+    void open_segment(segment& seg) {
+        seg.base = nullptr;
+        seg.cap = max_bytes_;
+        seg.offset.store(0, std::memory_order_relaxed);
+        seg.fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (seg.fd < 0) return;
+
+        struct ::stat st {};
+        std::size_t start = ::fstat(seg.fd, &st) == 0 ? static_cast<std::size_t>(st.st_size) : 0;
+        if (start >= seg.cap) {
+            // Existing file is already full: start a new one.
+            ::close(seg.fd);
+            auto staged = rotation_.stage();
+            seg.fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            rotation_.submit(std::move(staged));
+            if (seg.fd < 0) return;
+            start = 0;
+        }
+#if defined(__linux__)
+        const bool sized = ::posix_fallocate(seg.fd, 0, static_cast<::off_t>(seg.cap)) == 0 ||
+                           ::ftruncate(seg.fd, static_cast<::off_t>(seg.cap)) == 0;
+#else
+        const bool sized = ::ftruncate(seg.fd, static_cast<::off_t>(seg.cap)) == 0;
+#endif
+        if (sized) {
+#if defined(MAP_POPULATE)
+            constexpr int map_flags = MAP_SHARED | MAP_POPULATE; // prefault: no page faults on the write path
+#else
+            constexpr int map_flags = MAP_SHARED;
+#endif
+            void* p = ::mmap(nullptr, seg.cap, PROT_READ | PROT_WRITE, map_flags, seg.fd, 0);
+            if (p != MAP_FAILED) seg.base = static_cast<char*>(p);
+        }
+        if (!seg.base) {
+            (void)::ftruncate(seg.fd, static_cast<::off_t>(start));
+            ::close(seg.fd);
+            seg.fd = -1;
+            return;
+        }
+        seg.offset.store(start, std::memory_order_relaxed);
+    }
+
+    static void close_segment(segment& s, std::size_t used) {
+        if (s.base) {
+            if (used) ::msync(s.base, used, MS_ASYNC);
+            ::munmap(s.base, s.cap);
+            s.base = nullptr;
+        }
+        if (s.fd >= 0) {
+            (void)::ftruncate(s.fd, static_cast<::off_t>(used));
+            ::close(s.fd);
+            s.fd = -1;
+        }
+    }
+
+    // Pins the current segment. A writer that loses a race with rotation backs off before it
+    // touches the mapping, so the rotator only has to wait for `writers` to drain.
+    segment* acquire() noexcept {
+        for (;;) {
+            segment* s = current_.load(std::memory_order_acquire);
+            s->writers.fetch_add(1, std::memory_order_seq_cst);
+            if (current_.load(std::memory_order_seq_cst) == s) return s;
+            s->writers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    static void release(segment* s) noexcept { s->writers.fetch_sub(1, std::memory_order_release); }
+
+    void commit(std::string_view data) {
+        if (data.size() > max_bytes_) data = data.substr(0, max_bytes_);
+        const std::size_t n = data.size();
+        for (;;) {
+            segment* s = acquire();
+            if (!s->base) { // file could not be mapped: drop (logging must not throw)
+                release(s);
+                if (!reopen(s)) return;
+                continue;
+            }
+            const std::uint64_t id = s->id.load(std::memory_order_relaxed);
+            const std::size_t off = s->offset.fetch_add(n, std::memory_order_relaxed);
+            if (off + n <= s->cap) {
+                std::memcpy(s->base + off, data.data(), n);
+                release(s);
+                return;
+            }
+            release(s);
+            if (off <= s->cap) {
+                rotate(s, off); // exactly one writer crosses the end
+            } else {
+                while (current_.load(std::memory_order_acquire) == s && s->id.load(std::memory_order_relaxed) == id) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    // Swaps `old` for a freshly opened segment once every writer pinned on it has left.
+    void replace(segment* old, segment* fresh, std::size_t used) {
+        current_.store(fresh, std::memory_order_seq_cst);
+        while (old->writers.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+        close_segment(*old, used);
+    }
+
+    void rotate(segment* old, std::size_t used) {
+        auto staged = rotation_.stage();
+        segment* fresh = take_header();
+        open_segment(*fresh);
+        replace(old, fresh, used);
+        // Only now is the staged file complete (trimmed to `used`).
+        rotation_.submit(std::move(staged));
+        put_header(old);
+    }
+
+    // Called by a writer that found the current segment unmapped. One writer at a time, at most
+    // once per backoff period, tries to map the file again; true if `s` is no longer current.
+    bool reopen(segment* s) {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        if (now < retry_at_.load(std::memory_order_relaxed)) return false;
+        bool idle = false;
+        if (!reopening_.compare_exchange_strong(idle, true, std::memory_order_acquire)) return false;
+        bool swapped = current_.load(std::memory_order_acquire) != s;
+        if (!swapped) {
+            segment* fresh = take_header();
+            open_segment(*fresh);
+            if (fresh->base) {
+                replace(s, fresh, 0);
+                put_header(s);
+                retry_delay_ = min_retry;
+                swapped = true;
+            } else {
+                put_header(fresh);
+                retry_at_.store(now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(retry_delay_).count(),
+                               std::memory_order_relaxed);
+                retry_delay_ = std::min(retry_delay_ * 2, max_retry);
+            }
+        }
+        reopening_.store(false, std::memory_order_release);
+        return swapped;
+    }
+
+    std::filesystem::path path_;
+    std::size_t max_bytes_{};
+    bool sync_on_flush_ = false;
+    detail::rotation_worker rotation_;
+    std::atomic<segment*> current_{nullptr};
+    std::mutex headers_mu_;
+    std::vector<std::unique_ptr<segment>> headers_; // every header ever allocated (a handful)
+    std::vector<segment*> free_headers_;            // closed, unpinned, reusable
+    std::uint64_t header_uses_ = 0;
+    std::atomic<bool> reopening_{false};
+    std::atomic<std::int64_t> retry_at_{0}; // steady_clock ticks
+    std::chrono::milliseconds retry_delay_ = min_retry; // under reopening_
+};
+#endif
+
+class daily_file_sink : public sink {
+public:
+    explicit daily_file_sink(std::filesystem::path dir, file_writer_options opts = {}) : dir_(std::move(dir)), file_(opts) {
+        std::filesystem::create_directories(dir_);
+        open(date_string(std::chrono::system_clock::now()));
+    }
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        // Day-rollover check against the cached per-second prefix; no allocation per event.
+        const auto day = detail::cached_time(e.ts).date();
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            write_line(e, day);
+        } else {
+            write_line(e, day);
+        }
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_line(e, detail::cached_time(e.ts).date());
+            }
+        } else {
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_line(e, detail::cached_time(e.ts).date());
+            }
+        }
+    }
+
+    void flush() override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            if (file_.is_open()) file_.flush();
+        } else {
+            if (file_.is_open()) file_.flush();
+        }
+    }
+
+    // Skipped if a writer holds the lock: its buffer may be half-updated.
+    void crash_flush() noexcept override {
+        std::unique_lock<std::mutex> lk(m_, std::try_to_lock);
+        if (lk.owns_lock() || !thread_safe_) file_.crash_write();
+    }
+
+private:
+    void write_line(const log_event& e, std::string_view day) {
+        if (day != current_day_) rotate(std::string(day));
+        if (!file_.is_open()) return;
+        file_.append([&](std::string& out) {
+            render_to(out, e);
+            out.push_back('\n');
+        });
+    }
+
+    void open(const std::string& day) {
+        current_day_ = day;
+        file_.open(dir_ / (day + ".log"));
+    }
+
+    void rotate(const std::string& day) {
+        file_.close();
+        open(day);
+    }
+
+    std::filesystem::path dir_;
+    std::string current_day_;
+    detail::file_writer file_;
+    std::mutex m_;
+};
+
+class json_sink : public sink {
+public:
+    explicit json_sink(std::filesystem::path path, file_writer_options opts = {}) : path_(std::move(path)), file_(opts) {
+        if (!path_.parent_path().empty()) {
+            std::filesystem::create_directories(path_.parent_path());
+        }
+        file_.open(path_);
+    }
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            write_line(e);
+        } else {
+            write_line(e);
+        }
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_line(e);
+            }
+        } else {
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_line(e);
+            }
+        }
+    }
+
+    void flush() override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            if (file_.is_open()) file_.flush();
+        } else {
+            if (file_.is_open()) file_.flush();
+        }
+    }
+
+    // Skipped if a writer holds the lock: its buffer may be half-updated.
+    void crash_flush() noexcept override {
+        std::unique_lock<std::mutex> lk(m_, std::try_to_lock);
+        if (lk.owns_lock() || !thread_safe_) file_.crash_write();
+    }
+
+private:
+    void write_line(const log_event& e) {
+        if (!file_.is_open()) return;
+        file_.append([&](std::string& out) {
+            render_json_to(out, e);
+            out.push_back('\n');
+        });
+    }
+
+    std::filesystem::path path_;
+    detail::file_writer file_;
+    std::mutex m_;
+};
+
+// Compact binary log (decode with tools/chlog_decode.py). Events reference a call-site
+// dictionary that is written inline the first time each entry is used, so a record is a few
+// fixed-size fields plus either the formatted message or, with async.deferred_format, the raw
+// encoded arguments, followed by any kv() fields as they were encoded on the producer. All
+// integers are in host byte order (recorded in the header).
+//
+// Each opened file (or appended segment) starts with a header:
+//   "CHLOGBIN" u8 version, u8 little_endian, u8 sizeof(size_t), u8 sizeof(void*),
+//              u8 sizeof(long double), 3 reserved bytes
+// followed by records, each starting with a u8 tag:
+//   'S' site:  u32 id, u8 level, u32 line, str file, str func, str fmt, str arg_types
+//   'N' name:  u32 id, str name
+//   'E' event: u32 site, u32 name (0 = none), i64 ts_ns, u8 level, u64 tid, u64 seq,
+//              u8 kind (0 = text, 1 = encoded args), str payload, str fields
+// where str is a u32 length followed by the bytes, tid is std::hash of the thread id, encoded
+// args follow detail::encode_args (one arg_tag per argument in the site's arg_types) and fields
+// holds the Structured Fields records (empty for plain calls; absent in version 1 files).
+// Dictionary ids restart in every segment.
+class binary_file_sink : public sink {
+public:
+    static constexpr std::uint8_t format_version = 2;
+
+    explicit binary_file_sink(std::filesystem::path path, file_writer_options opts = {})
+        : path_(std::move(path)), file_(opts) {
+        if (!path_.parent_path().empty()) {
+            std::filesystem::create_directories(path_.parent_path());
+        }
+        if (file_.open(path_)) write_header();
+    }
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            write_record(e);
+        } else {
+            write_record(e);
+        }
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_record(e);
+            }
+        } else {
+            for (const auto& e : events) {
+                if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) write_record(e);
+            }
+        }
+    }
+
+    void flush() override {
+        if (thread_safe_) {
+            std::lock_guard<std::mutex> lk(m_);
+            if (file_.is_open()) file_.flush();
+        } else {
+            if (file_.is_open()) file_.flush();
+        }
+    }
+
+    // Skipped if a writer holds the lock: its buffer may be half-updated.
+    void crash_flush() noexcept override {
+        std::unique_lock<std::mutex> lk(m_, std::try_to_lock);
+        if (lk.owns_lock() || !thread_safe_) file_.crash_write();
+    }
+
+    bool accepts_deferred() const noexcept override { return true; }
+
+private:
+    template <class T>
+    static void put(std::string& out, T v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        char b[sizeof(T)];
+        std::memcpy(b, &v, sizeof(T));
+        out.append(b, sizeof(T));
+    }
+
+    static void put_str(std::string& out, std::string_view sv) {
+        put(out, static_cast<std::uint32_t>(sv.size()));
+        out.append(sv);
+    }
+
+    void write_header() {
+        file_.append([](std::string& out) {
+            out.append("CHLOGBIN");
+            put(out, format_version);
+            put(out, static_cast<std::uint8_t>(std::endian::native == std::endian::little));
+            put(out, static_cast<std::uint8_t>(sizeof(std::size_t)));
+            put(out, static_cast<std::uint8_t>(sizeof(void*)));
+            put(out, static_cast<std::uint8_t>(sizeof(long double)));
+            out.append(3, '\0');
+        });
+    }
+
+    // Dictionary key: call site plus (for encoded events) the format string and argument codec,
+    // since one site inside logger::log() is shared by every runtime format string.
+    using site_key = std::tuple<const call_site*, const char*, std::size_t, const detail::deferred_codec*>;
+
+    std::uint32_t site_id(std::string& out, const log_event& e) {
+        const std::string_view fmt = e.deferred ? e.deferred_fmt : (e.site ? e.site->fmt.view() : std::string_view{});
+        const site_key key{e.site, fmt.data(), fmt.size(), e.deferred};
+        auto it = sites_.find(key);
+        if (it != sites_.end()) return it->second;
+
+        const auto id = static_cast<std::uint32_t>(sites_.size() + 1);
+        sites_.emplace(key, id);
+        out.push_back('S');
+        put(out, id);
+        put(out, static_cast<std::uint8_t>(e.site ? e.site->lvl : level::off));
+        put(out, static_cast<std::uint32_t>(e.line()));
+        put_str(out, e.file());
+        put_str(out, e.func());
+        put_str(out, fmt);
+        put_str(out, e.deferred ? e.deferred->types : std::string_view{});
+        return id;
+    }
+
+    std::uint32_t name_id(std::string& out, std::string_view name) {
+        if (name.empty()) return 0;
+        auto it = names_.find(name);
+        if (it != names_.end()) return it->second;
+
+        const auto id = static_cast<std::uint32_t>(names_.size() + 1);
+        names_.emplace(std::string(name), id);
+        out.push_back('N');
+        put(out, id);
+        put_str(out, name);
+        return id;
+    }
+
+    void write_record(const log_event& e) {
+        if (!file_.is_open()) return;
+        file_.append([&](std::string& out) {
+            const std::uint32_t site = site_id(out, e);
+            const std::uint32_t name = name_id(out, e.name);
+            out.push_back('E');
+            put(out, site);
+            put(out, name);
+            put(out, static_cast<std::int64_t>(
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(e.ts.time_since_epoch()).count()));
+            put(out, static_cast<std::uint8_t>(e.lvl));
+            put(out, static_cast<std::uint64_t>(std::hash<std::thread::id>{}(e.tid)));
+            put(out, e.seq);
+            put(out, static_cast<std::uint8_t>(e.deferred ? 1 : 0));
+            put_str(out, e.message());
+            put_str(out, e.fields().records());
+        });
+    }
+
+    std::filesystem::path path_;
+    detail::file_writer file_;
+    std::mutex m_;
+    std::map<site_key, std::uint32_t> sites_;
+    std::map<std::string, std::uint32_t, std::less<>> names_;
+};
+
+// =========================== Network Sinks ===========================
+// Ship logs off-box without a sidecar: sinks render events into a bounded in-memory buffer
+// (dropping, and counting, whatever does not fit) and a per-sink I/O thread sends it with
+// non-blocking sockets and poll(), so log()/log_batch() never wait for the network. Connections
+// are kept open and re-established with exponential backoff. POSIX only; define
+// CHLOG_NO_NET_SINKS to leave them out.
+#if defined(CHLOG_NET_SINKS)
+
+struct net_sink_options {
+    std::size_t buffer_bytes = 4u << 20;             // rendered bytes held while the peer is slow/down
+    std::size_t batch_bytes = 64u * 1024;            // max bytes per write (per HTTP request)
+    std::chrono::milliseconds linger{200};           // max time a rendered line waits to be sent
+    std::chrono::milliseconds connect_timeout{3000};
+    std::chrono::milliseconds io_timeout{5000};      // per send / response wait
+    std::chrono::milliseconds retry_min{100};        // reconnect backoff, doubling up to retry_max
+    std::chrono::milliseconds retry_max{10000};
+    std::chrono::milliseconds shutdown_timeout{2000}; // destructor: time allowed to send what is left
+};
+
+namespace detail {
+
+// Non-blocking socket with poll()-based timeouts. Resolves the host on every connect so DNS
+// changes are picked up after a reconnect.
+class net_socket {
+public:
+    net_socket(std::string host, std::string port, int socktype)
+        : host_(std::move(host)), port_(std::move(port)), socktype_(socktype) {}
+    net_socket(const net_socket&) = delete;
+    net_socket& operator=(const net_socket&) = delete;
+    ~net_socket() { close(); }
+
+    bool connected() const noexcept { return fd_ >= 0; }
+    bool stream() const noexcept { return socktype_ == SOCK_STREAM; }
+    const std::string& host() const noexcept { return host_; }
+
+    bool connect(std::chrono::milliseconds timeout) {
+        close();
+        ::addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = socktype_;
+        ::addrinfo* res = nullptr;
+        if (::getaddrinfo(host_.c_str(), port_.c_str(), &hints, &res) != 0) return false;
+        for (auto* ai = res; ai && fd_ < 0; ai = ai->ai_next) {
+            const int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+            const int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || (errno == EINPROGRESS && wait(fd, POLLOUT, timeout) && socket_ok(fd))) {
+                fd_ = fd;
+            } else {
+                ::close(fd);
+            }
+        }
+        ::freeaddrinfo(res);
+        if (fd_ >= 0 && stream()) {
+            const int one = 1;
+            ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd_ >= 0;
+    }
+
+    void close() noexcept {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    // Writes all of `data` (one datagram on UDP); false on error or timeout.
+    bool send_all(std::string_view data, std::chrono::milliseconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!data.empty()) {
+            const auto n = ::send(fd_, data.data(), data.size(), send_flags);
+            if (n >= 0) {
+                if (!stream()) return static_cast<std::size_t>(n) == data.size();
+                data.remove_prefix(static_cast<std::size_t>(n));
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) || !wait(fd_, POLLOUT, remaining(deadline))) return false;
+        }
+        return true;
+    }
+
+    // Appends what arrives within `timeout` (at least one byte unless it fails); 0 on error,
+    // timeout or orderly close.
+    std::size_t recv_some(std::string& out, std::chrono::milliseconds timeout) {
+        char buf[4096];
+        for (;;) {
+            const auto n = ::recv(fd_, buf, sizeof(buf), 0);
+            if (n > 0) {
+                out.append(buf, static_cast<std::size_t>(n));
+                return static_cast<std::size_t>(n);
+            }
+            if (n == 0) return 0;
+            if (errno == EINTR) continue;
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) || !wait(fd_, POLLIN, timeout)) return 0;
+        }
+    }
+
+private:
+#if defined(MSG_NOSIGNAL)
+    static constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    static constexpr int send_flags = 0;
+#endif
+
+    static std::chrono::milliseconds remaining(std::chrono::steady_clock::time_point deadline) {
+        const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    }
+
+    static bool wait(int fd, short events, std::chrono::milliseconds timeout) {
+        ::pollfd p{fd, events, 0};
+        for (;;) {
+            const int r = ::poll(&p, 1, static_cast<int>(std::min<std::int64_t>(timeout.count(), 1 << 30)));
+            if (r < 0 && errno == EINTR) continue;
+            return r > 0 && (p.revents & (events | POLLHUP)) != 0 && (p.revents & (POLLERR | POLLNVAL)) == 0;
+        }
+    }
+
+    static bool socket_ok(int fd) {
+        int err = 0;
+        ::socklen_t len = sizeof(err);
+        return ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+    }
+
+    std::string host_;
+    std::string port_;
+    int socktype_;
+    int fd_ = -1;
+};
+
+// Wire format of one network sink: how a message is framed into the send buffer and how a
+// chunk of whole messages is put on the socket.
+class net_protocol {
+public:
+    enum class result {
+        sent,     // delivered (or, for datagrams, handed to the kernel)
+        rejected, // the peer refused it for good (HTTP 4xx); dropped, the connection stays usable
+        failed,   // I/O error or retryable answer; the sink backs off, reconnects and retries
+    };
+
+    virtual ~net_protocol() = default;
+    virtual std::string target() const = 0;
+    // True when frame() uses `text`, the event rendered with the sink's pattern.
+    virtual bool uses_pattern() const noexcept { return true; }
+    // Appends one framed message for `e`.
+    virtual void frame(std::string& out, const log_event& e, std::string_view text) = 0;
+    // `chunk` holds whole messages; `ends` are their end offsets within it.
+    virtual result send(net_socket& sock, std::string_view chunk, std::span<const std::uint32_t> ends,
+                        std::chrono::milliseconds timeout) = 0;
+};
+
+} // namespace detail
+
+// Core of the network sinks: bounded buffering, the I/O thread, reconnects and counters
+// (reported in metrics_snapshot::sinks). Concrete sinks supply the protocol.
+class network_sink : public sink {
+public:
+    network_sink(std::unique_ptr<detail::net_protocol> proto, std::unique_ptr<detail::net_socket> sock,
+                 net_sink_options opts)
+        : proto_(std::move(proto)), sock_(std::move(sock)), opts_(opts), target_(proto_->target()) {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    network_sink(const network_sink&) = delete;
+    network_sink& operator=(const network_sink&) = delete;
+
+    ~network_sink() override {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    bool static_level() const noexcept override { return true; }
+
+    void log(const log_event& e) override {
+        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
+        std::lock_guard<std::mutex> lk(mu_);
+        append(e);
+    }
+
+    void log_batch(std::span<const log_event> events) override {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (const auto& e : events) {
+            if (static_cast<int>(e.lvl) >= static_cast<int>(level_)) append(e);
+        }
+    }
+
+    // Asks the I/O thread to send what is buffered now; does not wait for the network.
+    void flush() override {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            if (pending_.empty()) return;
+            flush_requested_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    // Sends what is buffered and waits up to `timeout` for it to go out (or be dropped); false
+    // if something is still pending, e.g. because the peer is down.
+    bool drain(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lk(mu_);
+        flush_requested_ = true;
+        cv_.notify_one();
+        return idle_cv_.wait_for(lk, timeout, [this] { return pending_ends_.empty() && inflight_ == 0; });
+    }
+
+    bool report(sink_stats& out) const override {
+        out.target = target_;
+        out.sent = sent_.load(std::memory_order_relaxed);
+        out.dropped = dropped_.load(std::memory_order_relaxed);
+        out.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+        out.errors = errors_.load(std::memory_order_relaxed);
+        out.reconnects = reconnects_.load(std::memory_order_relaxed);
+        out.buffered_bytes = buffered_.load(std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    // Caller holds mu_.
+    void append(const log_event& e) {
+        const std::size_t before = pending_.size();
+        text_.clear();
+        if (proto_->uses_pattern()) render_to(text_, e);
+        proto_->frame(pending_, e, text_);
+        if (pending_.size() + inflight_ > opts_.buffer_bytes || pending_.size() - before > opts_.batch_bytes) {
+            pending_.resize(before);
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (pending_ends_.empty()) first_pending_ = std::chrono::steady_clock::now();
+        pending_ends_.push_back(static_cast<std::uint32_t>(pending_.size()));
+        buffered_.store(pending_.size() + inflight_, std::memory_order_relaxed);
+        if (pending_.size() >= opts_.batch_bytes) cv_.notify_one();
+    }
+
+    void run() {
+        std::string batch;
+        std::vector<std::uint32_t> ends;
+        std::size_t done = 0; // messages of `batch` already sent
+        auto backoff = opts_.retry_min;
+        auto next_try = std::chrono::steady_clock::time_point{};
+        bool ever_connected = false;
+        std::chrono::steady_clock::time_point stop_deadline{};
+
+        std::unique_lock<std::mutex> lk(mu_);
+        for (;;) {
+            const auto now = std::chrono::steady_clock::now();
+            if (stop_ && stop_deadline == std::chrono::steady_clock::time_point{}) stop_deadline = now + opts_.shutdown_timeout;
+            const bool idle = done == ends.size();
+            const bool due = !pending_ends_.empty() &&
+                             (stop_ || flush_requested_ || pending_.size() >= opts_.batch_bytes || now - first_pending_ >= opts_.linger);
+            if (idle && due) {
+                // Take everything buffered; it is sent in batch_bytes chunks below.
+                batch.swap(pending_);
+                ends.swap(pending_ends_);
+                pending_.clear();
+                pending_ends_.clear();
+                done = 0;
+                inflight_ = batch.size();
+                flush_requested_ = false;
+            } else if (idle) {
+                if (stop_) break;
+                const auto wake = pending_ends_.empty() ? now + opts_.linger : first_pending_ + opts_.linger;
+                cv_.wait_until(lk, wake);
+                continue;
+            } else if (now < next_try) {
+                if (stop_ && now >= stop_deadline) break;
+                cv_.wait_until(lk, stop_ ? std::min(next_try, stop_deadline) : next_try);
+                continue;
+            }
+            lk.unlock();
+
+            while (done < ends.size()) {
+                if (!sock_->connected()) {
+                    if (!sock_->connect(opts_.connect_timeout)) {
+                        errors_.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    if (ever_connected) reconnects_.fetch_add(1, std::memory_order_relaxed);
+                    ever_connected = true;
+                }
+                const std::size_t n = chunk_end(ends, done);
+                const std::uint32_t base = done == 0 ? 0 : ends[done - 1];
+                const std::string_view chunk(batch.data() + base, ends[n - 1] - base);
+                ends_rel_.clear();
+                for (std::size_t i = done; i < n; ++i) ends_rel_.push_back(ends[i] - base);
+                const auto r = proto_->send(*sock_, chunk, ends_rel_, opts_.io_timeout);
+                if (r == detail::net_protocol::result::failed) {
+                    sock_->close();
+                    errors_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                if (r == detail::net_protocol::result::sent) {
+                    sent_.fetch_add(n - done, std::memory_order_relaxed);
+                    bytes_sent_.fetch_add(chunk.size(), std::memory_order_relaxed);
+                } else {
+                    errors_.fetch_add(1, std::memory_order_relaxed);
+                    dropped_.fetch_add(n - done, std::memory_order_relaxed);
+                }
+                done = n;
+            }
+
+            lk.lock();
+            if (done < ends.size()) {
+                next_try = std::chrono::steady_clock::now() + backoff;
+                backoff = std::min(backoff * 2, opts_.retry_max);
+                if (stop_ && std::chrono::steady_clock::now() >= stop_deadline) break;
+            } else {
+                backoff = opts_.retry_min;
+                inflight_ = 0;
+                if (pending_ends_.empty()) idle_cv_.notify_all();
+            }
+            buffered_.store(pending_.size() + inflight_, std::memory_order_relaxed);
+        }
+        dropped_.fetch_add((ends.size() - done) + pending_ends_.size(), std::memory_order_relaxed);
+    }
+
+    // One past the last message that fits in a batch_bytes chunk starting at message `first`.
+    std::size_t chunk_end(const std::vector<std::uint32_t>& ends, std::size_t first) const {
+        const std::uint32_t base = first == 0 ? 0 : ends[first - 1];
+        std::size_t n = first + 1;
+        while (n < ends.size() && ends[n] - base <= opts_.batch_bytes) ++n;
+        return n;
+    }
+
+    std::unique_ptr<detail::net_protocol> proto_;
+    std::unique_ptr<detail::net_socket> sock_;
+    const net_sink_options opts_;
+    const std::string target_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_; // drain(): nothing pending or in flight
+    std::string pending_;                      // framed messages waiting for the I/O thread
+    std::vector<std::uint32_t> pending_ends_;  // end offset of each message in pending_
+    std::chrono::steady_clock::time_point first_pending_{};
+    std::size_t inflight_ = 0;                 // bytes taken by the I/O thread, not yet sent
+    std::string text_;                         // pattern rendering scratch
+    bool flush_requested_ = false;
+    bool stop_ = false;
+
+    std::vector<std::uint32_t> ends_rel_; // I/O thread scratch
+
+    std::atomic<std::size_t> sent_{0};
+    std::atomic<std::size_t> dropped_{0};
+    std::atomic<std::size_t> bytes_sent_{0};
+    std::atomic<std::size_t> errors_{0};
+    std::atomic<std::size_t> reconnects_{0};
+    std::atomic<std::size_t> buffered_{0};
+
+    std::thread thread_;
+};
+
+namespace detail {
+
+// RFC 5424 syslog. Datagrams carry one message each (truncated to max_datagram); on TCP
+// messages use octet-counting framing (RFC 6587 3.4.1).
+class syslog_protocol final : public net_protocol {
+public:
+    syslog_protocol(std::string host, std::string port, bool tcp, int facility, std::string app_name,
+                    std::size_t max_datagram, bool use_pattern)
+        : host_(std::move(host)), port_(std::move(port)), tcp_(tcp), use_pattern_(use_pattern), facility_(facility),
+          app_name_(sanitize(app_name, 48)), max_datagram_(max_datagram) {
+        char buf[256] = {};
+        hostname_ = ::gethostname(buf, sizeof(buf) - 1) == 0 ? sanitize(buf, 255) : std::string();
+        if (hostname_.empty()) hostname_ = "-";
+        procid_ = std::to_string(::getpid());
+    }
+
+    std::string target() const override { return std::string(tcp_ ? "syslog+tcp://" : "syslog+udp://") + host_ + ":" + port_; }
+    bool uses_pattern() const noexcept override { return use_pattern_; }
+
+    void frame(std::string& out, const log_event& e, std::string_view text) override {
+        std::string& msg = tcp_ ? scratch_ : out;
+        if (tcp_) msg.clear();
+        const std::size_t start = msg.size();
+        msg.push_back('<');
+        append_int(msg, facility_ * 8 + severity(e.lvl));
+        msg.append(">1 ");
+        append_rfc3339(msg, e.ts);
+        msg.push_back(' ');
+        msg.append(hostname_);
+        msg.push_back(' ');
+        if (!app_name_.empty()) {
+            msg.append(app_name_);
+        } else if (!e.name.empty()) {
+            msg.append(sanitize(e.name, 48));
+        } else {
+            msg.push_back('-');
+        }
+        msg.push_back(' ');
+        msg.append(procid_);
+        msg.append(" - - ");
+        if (use_pattern_) {
+            msg.append(text);
+        } else {
+            append_message(msg, e);
+        }
+
+        if (tcp_) {
+            append_int(out, msg.size());
+            out.push_back(' ');
+            out.append(msg);
+        } else if (msg.size() - start > max_datagram_) {
+            msg.resize(start + max_datagram_);
+        }
+    }
+
+    result send(net_socket& sock, std::string_view chunk, std::span<const std::uint32_t> ends,
+                std::chrono::milliseconds timeout) override {
+        if (tcp_) return sock.send_all(chunk, timeout) ? result::sent : result::failed;
+        std::uint32_t begin = 0;
+        for (const std::uint32_t end : ends) {
+            // Datagrams are fire-and-forget: a refused one (no listener yet) is not retried.
+            if (!sock.send_all(chunk.substr(begin, end - begin), timeout) && errno != ECONNREFUSED) return result::failed;
+            begin = end;
+        }
+        return result::sent;
+    }
+
+private:
+    static int severity(level lv) noexcept {
+        switch (lv) {
+            case level::trace:
+            case level::debug: return 7;
+            case level::info: return 6;
+            case level::warn: return 4;
+            case level::error: return 3;
+            case level::critical: return 2;
+            case level::off: break;
+        }
+        return 6;
+    }
+
+    // HOSTNAME / APP-NAME: printable US-ASCII without spaces.
+    static std::string sanitize(std::string_view s, std::size_t max) {
+        std::string out;
+        for (const char c : s.substr(0, std::min(s.size(), max)))
+            out.push_back(c > 32 && c < 127 ? c : '_');
+        return out;
+    }
+
+    static void append_rfc3339(std::string& out, std::chrono::system_clock::time_point tp) {
+        if (tp.time_since_epoch().count() == 0) {
+            out.push_back('-'); // NILVALUE: timestamp capture is off
+            return;
+        }
+        const auto secs = std::chrono::floor<std::chrono::seconds>(tp);
+        const std::time_t t = std::chrono::system_clock::to_time_t(secs);
+        std::tm tm{};
+        ::gmtime_r(&t, &tm);
+        char buf[27];
+        write_padded(buf, static_cast<unsigned>(tm.tm_year + 1900), 4);
+        buf[4] = '-';
+        write_padded(buf + 5, static_cast<unsigned>(tm.tm_mon + 1), 2);
+        buf[7] = '-';
+        write_padded(buf + 8, static_cast<unsigned>(tm.tm_mday), 2);
+        buf[10] = 'T';
+        write_padded(buf + 11, static_cast<unsigned>(tm.tm_hour), 2);
+        buf[13] = ':';
+        write_padded(buf + 14, static_cast<unsigned>(tm.tm_min), 2);
+        buf[16] = ':';
+        write_padded(buf + 17, static_cast<unsigned>(tm.tm_sec), 2);
+        buf[19] = '.';
+        write_padded(buf + 20, subsecond<std::micro>(tp), 6);
+        buf[26] = 'Z';
+        out.append(buf, sizeof(buf));
+    }
+
+    std::string host_;
+    std::string port_;
+    bool tcp_;
+    bool use_pattern_;
+    int facility_;
+    std::string app_name_;
+    std::size_t max_datagram_;
+    std::string hostname_;
+    std::string procid_;
+    std::string scratch_;
+};
+
+// Newline-delimited JSON POSTed over HTTP/1.1 keep-alive connections (plain HTTP only).
+class http_ndjson_protocol final : public net_protocol {
+public:
+    http_ndjson_protocol(std::string host, std::string port, std::string path, std::vector<std::string> headers)
+        : host_(std::move(host)), port_(std::move(port)), path_(std::move(path)) {
+        head_ = "POST " + path_ + " HTTP/1.1\r\nHost: " + host_ + (port_ == "80" ? "" : ":" + port_) +
+                "\r\nContent-Type: application/x-ndjson\r\nConnection: keep-alive\r\n";
+        for (const auto& h : headers) head_ += h + "\r\n";
+        head_ += "Content-Length: ";
+    }
+
+    std::string target() const override { return "http://" + host_ + ":" + port_ + path_; }
+
+    bool uses_pattern() const noexcept override { return false; }
+
+    void frame(std::string& out, const log_event& e, std::string_view) override {
+        render_json_to(out, e);
+        out.push_back('\n');
+    }
+
+    result send(net_socket& sock, std::string_view chunk, std::span<const std::uint32_t>,
+                std::chrono::milliseconds timeout) override {
+        request_.assign(head_);
+        append_int(request_, chunk.size());
+        request_.append("\r\n\r\n");
+        request_.append(chunk);
+        if (!sock.send_all(request_, timeout)) return result::failed;
+
+        // Status line + headers, then skip a Content-Length body so the connection can be reused.
+        response_.clear();
+        std::size_t header_end;
+        while ((header_end = response_.find("\r\n\r\n")) == std::string::npos) {
+            if (response_.size() > 64 * 1024 || sock.recv_some(response_, timeout) == 0) return result::failed;
+        }
+        const std::string_view head(response_.data(), header_end);
+        int status = 0;
+        if (head.size() < 12 || head.substr(0, 5) != "HTTP/" ||
+            std::from_chars(head.data() + 9, head.data() + 12, status).ec != std::errc{})
+            return result::failed;
+
+        const auto content_length = header_value(head, "content-length");
+        bool reusable = !content_length.empty() && !contains_token(header_value(head, "connection"), "close");
+        if (reusable) {
+            std::size_t len = 0;
+            std::from_chars(content_length.data(), content_length.data() + content_length.size(), len);
+            while (response_.size() - (header_end + 4) < len) {
+                if (sock.recv_some(response_, timeout) == 0) {
+                    reusable = false;
+                    break;
+                }
+            }
+        }
+        if (!reusable) sock.close();
+
+        if (status >= 200 && status < 300) return result::sent;
+        if (status >= 400 && status < 500 && status != 408 && status != 429) return result::rejected;
+        return result::failed;
+    }
+
+private:
+    static char lower(char c) noexcept { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; }
+
+    static bool iequals(std::string_view a, std::string_view b) noexcept {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return lower(x) == lower(y); });
+    }
+
+    static bool contains_token(std::string_view v, std::string_view token) noexcept {
+        for (std::size_t i = 0; i + token.size() <= v.size(); ++i) {
+            if (iequals(v.substr(i, token.size()), token)) return true;
+        }
+        return false;
+    }
+
+    // Value of header `name` (lowercase) in `head`, trimmed; empty when absent.
+    static std::string_view header_value(std::string_view head, std::string_view name) noexcept {
+        std::size_t pos = head.find("\r\n");
+        while (pos != std::string_view::npos) {
+            const std::size_t start = pos + 2;
+            const std::size_t end = std::min(head.find("\r\n", start), head.size());
+            const std::string_view line = head.substr(start, end - start);
+            const std::size_t colon = line.find(':');
+            if (colon != std::string_view::npos && iequals(line.substr(0, colon), name)) {
+                std::string_view v = line.substr(colon + 1);
+                while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+                while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+                return v;
+            }
+            pos = end < head.size() ? end : std::string_view::npos;
+        }
+        return {};
+    }
+
+    std::string host_;
+    std::string port_;
+    std::string path_;
+    std::string head_;
+    std::string request_;
+    std::string response_;
+};
+
+} // namespace detail
+
+struct syslog_sink_options {
+    enum class transport { udp, tcp };
+    transport proto = transport::udp;
+    int facility = 1;       // user-level messages
+    std::string app_name;   // empty => the logger name
+    std::size_t max_datagram = 2048; // UDP: longer messages are truncated
+    bool use_pattern = false; // MSG = the line rendered with the sink's pattern instead of the message
+    net_sink_options net{};
+};
+
+// RFC 5424 syslog over UDP or TCP. MSG is the bare message by default, since the syslog header
+// already carries time, severity, host and app; set use_pattern to send the formatted line.
+class syslog_sink final : public network_sink {
+public:
+    explicit syslog_sink(std::string host, std::uint16_t port = 514, syslog_sink_options opts = {})
+        : network_sink(std::make_unique<detail::syslog_protocol>(host, std::to_string(port),
+                                                                 opts.proto == syslog_sink_options::transport::tcp,
+                                                                 opts.facility, opts.app_name, opts.max_datagram,
+                                                                 opts.use_pattern),
+                       std::make_unique<detail::net_socket>(host, std::to_string(port),
+                                                            opts.proto == syslog_sink_options::transport::tcp ? SOCK_STREAM : SOCK_DGRAM),
+                       opts.net) {}
+};
+
+struct http_sink_options {
+    std::vector<std::string> headers; // extra request headers, e.g. "Authorization: Bearer ..."
+    net_sink_options net{};
+};
+
+// Ships batches of NDJSON ("{json}" records, one per line) to an HTTP endpoint such as a log
+// collector's bulk intake. `url` is "http://host[:port][/path]"; for TLS point it at a local
+// agent or proxy. 2xx responses count as sent, other 4xx (except 408/429) drop the batch, and
+// anything else is retried with backoff.
+class http_sink final : public network_sink {
+public:
+    explicit http_sink(std::string_view url, http_sink_options opts = {})
+        : http_sink(parse_url(url), std::move(opts)) {}
+
+private:
+    struct url_parts {
+        std::string host;
+        std::string port;
+        std::string path;
+    };
+
+    http_sink(url_parts u, http_sink_options opts)
+        : network_sink(std::make_unique<detail::http_ndjson_protocol>(u.host, u.port, u.path, std::move(opts.headers)),
+                       std::make_unique<detail::net_socket>(u.host, u.port, SOCK_STREAM), opts.net) {}
+
+    static url_parts parse_url(std::string_view url) {
+        constexpr std::string_view scheme = "http://";
+        if (url.substr(0, scheme.size()) != scheme) throw std::invalid_argument("chlog: http_sink needs an http:// URL");
+        url.remove_prefix(scheme.size());
+        const std::size_t slash = url.find('/');
+        std::string_view authority = url.substr(0, slash);
+        url_parts u;
+        u.path = slash == std::string_view::npos ? "/" : std::string(url.substr(slash));
+        const std::size_t colon = authority.rfind(':');
+        if (colon != std::string_view::npos && authority.find(']', colon) == std::string_view::npos) {
+            u.port = std::string(authority.substr(colon + 1));
+            authority = authority.substr(0, colon);
+        } else {
+            u.port = "80";
+        }
+        if (authority.size() > 1 && authority.front() == '[' && authority.back() == ']')
+            authority = authority.substr(1, authority.size() - 2);
+        if (authority.empty()) throw std::invalid_argument("chlog: http_sink URL has no host");
+        u.host = std::string(authority);
+        return u;
+    }
+};
+
+#endif // CHLOG_NET_SINKS
+
+// =========================== Crash Handler ===========================
+// Opt-in post-mortem flush (install_crash_handler()). On a fatal signal the handler stops new
+// log calls, lets every async worker drain its queue into the sinks (warn+ lanes first), hands
+// what the file sinks still buffer to the kernel with write(2), and then re-raises the signal
+// under the previous disposition, so the process still dies (and dumps core) as before.
+//
+// The handler itself only does async-signal-safe things: atomics, clock_gettime, nanosleep,
+// write, sigaction, raise and (on Linux) a futex wake of workers parked on an empty queue. The
+// drain runs on the worker threads, outside signal context, and is bounded by drain_timeout: a
+// worker can be stuck on a lock the crashed thread held, or be the thread that crashed.
+
+namespace detail {
+
+// Non-zero once a crash handler has started: log calls are dropped and async workers drain.
+inline std::atomic<int> crash_state{0};
+inline std::atomic<std::int64_t> crash_deadline_ns{0}; // steady_clock, end of the drain window
+
+inline bool crash_draining() noexcept { return crash_state.load(std::memory_order_relaxed) != 0; }
+
+inline std::int64_t crash_clock_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline bool crash_deadline_passed() noexcept {
+    return crash_clock_ns() >= crash_deadline_ns.load(std::memory_order_acquire);
+}
+
+// What the crash handler drives (implemented by logger). Both calls run in signal context.
+class crash_target {
+public:
+    // True once everything this target had queued has been handed to its sinks.
+    virtual bool crash_drained() const noexcept = 0;
+    // sink::crash_flush() on every attached sink.
+    virtual void crash_flush_sinks() noexcept = 0;
+    // Wakes the async worker if it is parked on an empty queue, so it starts draining now.
+    virtual void crash_wake() noexcept = 0;
+
+protected:
+    ~crash_target() = default;
+};
+
+// Fixed table of live loggers, lock-free so the handler can walk it. Constant-initialized.
+class crash_registry {
+public:
+    static constexpr std::size_t capacity = 256; // loggers past this are not flushed on a crash
+
+    void add(crash_target* t) noexcept {
+        for (auto& s : slots_) {
+            crash_target* expected = nullptr;
+            if (s.compare_exchange_strong(expected, t, std::memory_order_release, std::memory_order_relaxed)) return;
+        }
+    }
+
+    void remove(crash_target* t) noexcept {
+        for (auto& s : slots_) {
+            crash_target* expected = t;
+            if (s.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed)) return;
+        }
+    }
+
+    template <class Fn>
+    void for_each(Fn&& fn) const noexcept {
+        for (const auto& s : slots_) {
+            if (auto* t = s.load(std::memory_order_acquire)) fn(*t);
+        }
+    }
+
+private:
+    std::array<std::atomic<crash_target*>, capacity> slots_{};
+};
+
+inline crash_registry crash_targets;
+
+} // namespace detail
+
+#if !defined(_WIN32)
+
+struct crash_handler_options {
+    std::vector<int> signals{SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+    std::chrono::milliseconds drain_timeout{1000}; // how long the handler waits for the workers
+};
+
+namespace detail {
+
+struct crash_handler_state {
+    static constexpr std::size_t max_signals = 16;
+
+    std::atomic<bool> installed{false};
+    std::size_t count = 0;
+    int signals[max_signals]{};
+    struct ::sigaction previous[max_signals]{};
+    std::int64_t timeout_ns = 0;
+};
+
+inline crash_handler_state crash_handler;
+
+inline void crash_sleep_1ms() noexcept {
+    ::timespec ts{0, 1000000};
+    ::nanosleep(&ts, nullptr);
+}
+
+inline void on_crash_signal(int sig) {
+    const int saved_errno = errno;
+    int expected = 0;
+    if (crash_state.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+        // First fatal signal: open the drain window, wait for the workers, write out the buffers.
+        crash_deadline_ns.store(crash_clock_ns() + crash_handler.timeout_ns, std::memory_order_release);
+        crash_targets.for_each([](crash_target& t) { t.crash_wake(); });
+        for (;;) {
+            bool drained = true;
+            crash_targets.for_each([&](const crash_target& t) { drained = drained && t.crash_drained(); });
+            if (drained || crash_deadline_passed()) break;
+            crash_sleep_1ms();
+        }
+        crash_targets.for_each([](crash_target& t) { t.crash_flush_sinks(); });
+        crash_state.store(2, std::memory_order_release);
+    } else {
+        // Another thread is already flushing: give it its window before dying.
+        while (crash_state.load(std::memory_order_acquire) == 1 && !crash_deadline_passed()) crash_sleep_1ms();
+    }
+
+    // Re-raise under the previous disposition (it runs once this handler returns: the signal is
+    // blocked until then). A faulting instruction simply faults again.
+    for (std::size_t i = 0; i < crash_handler.count; ++i) {
+        if (crash_handler.signals[i] == sig) ::sigaction(sig, &crash_handler.previous[i], nullptr);
+    }
+    ::raise(sig);
+    errno = saved_errno;
+}
+
+} // namespace detail
+
+// Installs the crash handler for `opts.signals` (once per process; later calls return false).
+// Every logger then takes part automatically. Meant for fatal signals: after it has run, logging
+// stays off. Uses an alternate signal stack if the thread has one (sigaltstack), which a stack
+// overflow needs. Console output is not flushed (std::cout is not async-signal-safe).
+inline bool install_crash_handler(const crash_handler_options& opts = {}) {
+    auto& h = detail::crash_handler;
+    if (h.installed.exchange(true)) return false;
+    h.timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(opts.drain_timeout).count();
+    struct ::sigaction sa {};
+    sa.sa_handler = &detail::on_crash_signal;
+    sa.sa_flags = SA_ONSTACK;
+    ::sigemptyset(&sa.sa_mask);
+    for (const int sig : opts.signals) {
+        if (h.count == detail::crash_handler_state::max_signals) break;
+        if (::sigaction(sig, &sa, &h.previous[h.count]) == 0) h.signals[h.count++] = sig;
+    }
+    return h.count > 0;
+}
+
+#endif // !_WIN32
+
+// =========================== Lock-free Dual Queue (MPSC, bounded) ===========================
+// Goal: "industrial-grade" async performance.
+//
+// - Multi-producer / single-consumer.
+// - Bounded, lock-free fast path (CAS-based ring, no mutex on try_push/pop).
+// - Two independent rings:
+//   - high priority for warn+
+//   - low priority for trace/debug/info
+//   This reserves capacity so low-priority bursts can't starve warn+.
+
+namespace detail {
+
+inline constexpr bool is_pow2(std::size_t x) noexcept { return x != 0 && ((x & (x - 1)) == 0); }
+
+inline constexpr std::size_t round_up_pow2(std::size_t x) noexcept {
+    if (x <= 1) return 1;
+    --x;
+    for (std::size_t i = 1; i < sizeof(std::size_t) * 8; i <<= 1) x |= (x >> i);
+    return x + 1;
+}
+
+// Spin-wait hint (PAUSE / YIELD); keeps polling loops from starving a sibling hyperthread.
+inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    __yield();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Pins the calling thread to `cpu`; best-effort (returns false if unsupported or refused).
+inline bool pin_current_thread(int cpu) noexcept {
+#if defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Full-queue accounting for one ring. `rejected`/`blocked` are bumped by producers (only when
+// the ring is full); the high watermark is maintained by the consumer on its own line.
+struct ring_counters {
+    alignas(64) std::atomic<std::size_t> rejected{0};
+    std::atomic<std::size_t> blocked{0};
+    alignas(64) std::atomic<std::size_t> high_watermark{0};
+
+    void note_rejected() noexcept { rejected.fetch_add(1, std::memory_order_relaxed); }
+    void note_blocked() noexcept { blocked.fetch_add(1, std::memory_order_relaxed); }
+
+    // Consumer-only.
+    void note_occupancy(std::size_t n) noexcept {
+        if (n > high_watermark.load(std::memory_order_relaxed)) high_watermark.store(n, std::memory_order_relaxed);
+    }
+
+    ring_stats snapshot(std::size_t capacity, std::size_t size) const noexcept {
+        ring_stats r;
+        r.capacity = capacity;
+        r.size = size;
+        r.high_watermark = std::max(size, high_watermark.load(std::memory_order_relaxed));
+        r.blocked = blocked.load(std::memory_order_relaxed);
+        // A rejected push either blocked or was dropped.
+        r.dropped = std::max(r.blocked, rejected.load(std::memory_order_relaxed)) - r.blocked;
+        return r;
+    }
+};
+
+// Binary wakeup for a single waiter: post() leaves at most one pending wakeup. On Linux it is a
+// raw futex, so post() is async-signal-safe and the crash handler may call it; elsewhere it is a
+// semaphore (`signal_safe` tells which).
+class wake_signal {
+public:
+#if defined(__linux__)
+    static constexpr bool signal_safe = true;
+
+    void post() noexcept {
+        word_.store(1, std::memory_order_release);
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // Returns early once posted (consuming the wakeup) or on a spurious futex return.
+    void wait_for(std::chrono::milliseconds dur) noexcept {
+        if (word_.exchange(0, std::memory_order_acquire) != 0) return;
+        const auto ms = std::max<std::int64_t>(0, dur.count());
+        ::timespec ts{static_cast<::time_t>(ms / 1000), static_cast<long>(ms % 1000) * 1000000L};
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word_), FUTEX_WAIT_PRIVATE, 0u, &ts, nullptr, 0);
+        (void)word_.exchange(0, std::memory_order_acquire);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t) &&
+                  std::atomic<std::uint32_t>::is_always_lock_free);
+    std::atomic<std::uint32_t> word_{0};
+#else
+    static constexpr bool signal_safe = false;
+
+    void post() noexcept { sem_.release(); }
+    void wait_for(std::chrono::milliseconds dur) noexcept { (void)sem_.try_acquire_for(dur); }
+
+private:
+    // counting_semaphore<1> behaves like a binary semaphore and avoids permit buildup.
+    std::counting_semaphore<1> sem_{0};
+#endif
+};
+
+// Wakeup/backpressure state shared by a queue's rings.
+//
+// Consumer wakeup: the consumer advertises `sleeping` and re-checks for data before parking on
+// `data_ready`; producers only post it when they observe `sleeping`.
+//
+// Backpressure: a producer that finds the queue full registers in `space_waiters` and blocks
+// on `space_epoch` (atomic::wait); the consumer bumps the epoch after freeing slots, but only
+// when someone is registered, so the common case costs one load. Both handshakes are
+// Dekker-style (write own flag, fence, read the other side's state), so no wakeup is lost.
+struct queue_wait {
+    // Hint to reduce producer-side cacheline traffic: producers notify only if the
+    // consumer is likely waiting.
+    std::atomic<bool> sleeping{false};
+    // Wakeup for the single consumer.
+    wake_signal data_ready;
+    std::atomic<bool> stop{false};
+
+    alignas(64) std::atomic<std::uint32_t> space_waiters{0};
+    std::atomic<std::uint32_t> space_epoch{0};
+
+    // Producer, after publishing an element.
+    void notify_data() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false, std::memory_order_relaxed)) {
+            data_ready.post();
+        }
+    }
+
+    // Consumer: park for up to `dur` unless has_data() (checked again after advertising sleep).
+    template <class HasData>
+    void wait_for_data(std::chrono::milliseconds dur, HasData&& has_data) {
+        if (has_data()) return;
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!stop.load(std::memory_order_relaxed) && !has_data()) data_ready.wait_for(dur);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    // Producer: retries try_push() until it succeeds or the queue is stopped, sleeping while full.
+    template <class TryPush>
+    void push_blocking(TryPush&& try_push) {
+        for (;;) {
+            if (stop.load(std::memory_order_relaxed)) return;
+            if (try_push()) return;
+
+            space_waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::uint32_t epoch = space_epoch.load(std::memory_order_acquire);
+            // Re-check after registering: space freed before the consumer saw us must not be missed.
+            const bool done = stop.load(std::memory_order_relaxed) || try_push();
+            if (!done) space_epoch.wait(epoch, std::memory_order_acquire);
+            space_waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (done) return;
+        }
+    }
+
+    // Consumer, after freeing slots.
+    void notify_space() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (space_waiters.load(std::memory_order_relaxed) == 0) return;
+        space_epoch.fetch_add(1, std::memory_order_release);
+        space_epoch.notify_all();
+    }
+
+    void signal_stop() noexcept {
+        stop.store(true, std::memory_order_relaxed);
+        // Wake consumer if sleeping.
+        data_ready.post();
+        space_epoch.fetch_add(1, std::memory_order_release);
+        space_epoch.notify_all();
+    }
+
+    // Wakes the consumer if it is parked; async-signal-safe when wake_signal::signal_safe.
+    void wake() noexcept { data_ready.post(); }
+};
+
+template <class T>
+class mpsc_ring {
+public:
+    mpsc_ring(std::size_t cap, queue_wait* wait) : cap_(detail::round_up_pow2(cap)), mask_(cap_ - 1), wait_(wait) {
+        if (!detail::is_pow2(cap_)) {
+            cap_ = detail::round_up_pow2(cap_);
+            mask_ = cap_ - 1;
+        }
+        buffer_.reset(new cell[cap_]);
+        for (std::size_t i = 0; i < cap_; ++i) buffer_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpsc_ring() {
+        // Best-effort drain to destroy remaining elements.
+        T tmp;
+        while (try_pop(tmp)) {
+        }
+    }
+
+    mpsc_ring(const mpsc_ring&) = delete;
+    mpsc_ring& operator=(const mpsc_ring&) = delete;
+
+    bool try_push(T&& v) {
+        if (wait_ && wait_->stop.load(std::memory_order_relaxed)) return false;
+
+        cell* c = nullptr;
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &buffer_[pos & mask_];
+            const std::size_t seq = c->seq.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (&c->storage) T(std::move(v));
+        c->seq.store(pos + 1, std::memory_order_release);
+
+        // Wake consumer only if it is likely sleeping.
+        if (wait_) wait_->notify_data();
+        return true;
+    }
+
+    void push_blocking(T&& v) {
+        // Blocking is not the hot path; used primarily for warn+ overload cases.
+        if (!wait_) {
+            while (!try_push(std::move(v))) std::this_thread::yield();
+            return;
+        }
+        wait_->push_blocking([&] { return try_push(std::move(v)); });
+    }
+
+    std::size_t pop_batch(std::vector<T>& out, std::size_t max_batch) {
+        std::size_t n = 0;
+        T item;
+        while (n < max_batch && try_pop(item)) {
+            out.push_back(std::move(item));
+            ++n;
+        }
+
+        if (n > 0 && wait_) wait_->notify_space();
+
+        return n;
+    }
+
+    void wait_for_data(std::chrono::milliseconds dur) {
+        if (!wait_) {
+            std::this_thread::sleep_for(dur);
+            return;
+        }
+        // Single consumer: sleep using semaphore to reduce overhead vs condition_variable.
+        wait_->wait_for_data(dur, [&] { return size_relaxed() > 0; });
+    }
+
+    void signal_stop() {
+        if (wait_) wait_->signal_stop();
+    }
+
+    std::size_t size_relaxed() const noexcept {
+        // Approximate size (may transiently include reserved-but-not-published slots).
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+    std::size_t capacity() const noexcept { return cap_; }
+
+private:
+    struct cell {
+        std::atomic<std::size_t> seq{0};
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    bool try_pop(T& out) {
+        cell* c = nullptr;
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &buffer_[pos & mask_];
+            const std::size_t seq = c->seq.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* obj = reinterpret_cast<T*>(&c->storage);
+        out = std::move(*obj);
+        obj->~T();
+        c->seq.store(pos + cap_, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t cap_;
+    std::size_t mask_;
+    std::unique_ptr<cell[]> buffer_;
+
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    queue_wait* wait_;
+};
+
+// Wait-free bounded SPSC ring (Lamport queue with cached indices). Used by
+// per_thread_queue: one ring per producer thread, drained by the single consumer.
+template <class T>
+class spsc_ring {
+public:
+    explicit spsc_ring(std::size_t cap) : cap_(round_up_pow2(cap)), mask_(cap_ - 1), buffer_(new cell[cap_]) {}
+
+    ~spsc_ring() {
+        while (T* v = front()) {
+            (void)v;
+            pop();
+        }
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // Producer side.
+    bool try_push(T&& v) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == cap_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == cap_) return false; // full
+        }
+        new (&buffer_[tail & mask_].storage) T(std::move(v));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    T* front() noexcept {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return nullptr; // empty
+        }
+        return std::launder(reinterpret_cast<T*>(&buffer_[head & mask_].storage));
+    }
+
+    void pop() noexcept {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        std::launder(reinterpret_cast<T*>(&buffer_[head & mask_].storage))->~T();
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    std::size_t size_relaxed() const noexcept {
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+    std::size_t capacity() const noexcept { return cap_; }
+
+private:
+    struct cell {
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::size_t cap_;
+    std::size_t mask_;
+    std::unique_ptr<cell[]> buffer_;
+
+    // Consumer-owned line.
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0;
+    // Producer-owned line.
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_ = 0;
+};
+
+inline constexpr std::size_t align8(std::size_t n) noexcept { return (n + 7) & ~std::size_t{7}; }
+
+// Variable-length MPSC byte ring for log records.
+//
+// Producers reserve exactly align8(header + name + payload) bytes with a single CAS on a
+// monotonically increasing byte offset and serialize the event in place; the consumer
+// decodes records straight out of the ring into reusable log_event slots. Compared to
+// mpsc_ring<log_event> this packs many more short messages into the same memory and
+// avoids handing heap buffers from producers to the worker.
+//
+// Record layout (8-byte aligned):
+//   [u64 commit word][record_meta][name bytes][payload bytes][pad to 8]
+// The commit word is 0 until the producer publishes the record (release). Records that
+// would straddle the end of the buffer are preceded by a skip record covering the tail.
+// The consumer zeroes every byte it consumes, so any offset a producer can reserve reads
+// as "not committed" until it is published.
+class byte_ring {
+public:
+    byte_ring(std::size_t cap_bytes, queue_wait* wait)
+        : cap_(round_up_pow2(std::max<std::size_t>(cap_bytes, 4096))), mask_(cap_ - 1), wait_(wait) {
+        words_.reset(new std::uint64_t[cap_ / sizeof(std::uint64_t)]());
+    }
+
+    byte_ring(const byte_ring&) = delete;
+    byte_ring& operator=(const byte_ring&) = delete;
+
+    bool try_push(const log_event& e) {
+        if (wait_ && wait_->stop.load(std::memory_order_relaxed)) return false;
+
+        std::string_view payload = e.payload;
+        std::string_view fields = e.payload.trailer();
+        auto deferred = e.deferred;
+
+        // Keep single records well below the ring size so a push can always succeed once
+        // the consumer catches up.
+        const std::size_t max_body = cap_ / 2 - header_size;
+        if (payload.size() + fields.size() > max_body) {
+            // Encoded deferred arguments can't be truncated; fall back to the raw format string.
+            // Nor can field records; those are dropped and only the message is kept.
+            if (deferred) {
+                payload = e.deferred_fmt;
+                deferred = nullptr;
+            }
+            fields = {};
+            payload = payload.substr(0, std::min(payload.size(), max_body));
+        }
+
+        const std::size_t need = align8(header_size + payload.size() + fields.size());
+
+        std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+        std::size_t pad = 0;
+        for (;;) {
+            const std::size_t off = static_cast<std::size_t>(pos) & mask_;
+            pad = (off + need > cap_) ? (cap_ - off) : 0;
+            const std::uint64_t head = head_.load(std::memory_order_acquire);
+            if (pos + pad + need - head > cap_) return false; // full
+            if (tail_.compare_exchange_weak(pos, pos + pad + need, std::memory_order_relaxed)) break;
+        }
+
+        if (pad) commit(pos, pad | skip_bit);
+        pos += pad;
+
+        unsigned char* p = bytes_at(pos);
+        new (p + sizeof(std::uint64_t)) record_meta{e.ts,
+                                                   e.tid,
+                                                   e.site,
+                                                   e.seq,
+                                                   deferred,
+                                                   e.deferred_fmt,
+                                                   e.name,
+                                                   static_cast<std::uint32_t>(payload.size()),
+                                                   e.origin,
+                                                   e.lvl,
+                                                   static_cast<std::uint32_t>(fields.size())};
+        if (!payload.empty()) std::memcpy(p + header_size, payload.data(), payload.size());
+        if (!fields.empty()) std::memcpy(p + header_size + payload.size(), fields.data(), fields.size());
+        commit(pos, need);
+
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+
+        // Wake consumer only if it is likely sleeping.
+        if (wait_) wait_->notify_data();
+        return true;
+    }
+
+    void push_blocking(const log_event& e) {
+        if (!wait_) {
+            while (!try_push(e)) std::this_thread::yield();
+            return;
+        }
+        wait_->push_blocking([&] { return try_push(e); });
+    }
+
+    // Decodes up to max_batch records into out[first..], reusing the slots' string storage.
+    std::size_t pop_into(std::vector<log_event>& out, std::size_t first, std::size_t max_batch) {
+        std::size_t n = 0;
+        while (n < max_batch) {
+            if (out.size() <= first + n) out.emplace_back();
+            if (!try_pop(out[first + n])) break;
+            ++n;
+        }
+
+        if (n > 0 && wait_) wait_->notify_space();
+        return n;
+    }
+
+    std::size_t size_relaxed() const noexcept {
+        return static_cast<std::size_t>(pushed_.load(std::memory_order_relaxed) - popped_.load(std::memory_order_relaxed));
+    }
+    std::size_t capacity_bytes() const noexcept { return cap_; }
+    std::size_t used_bytes_relaxed() const noexcept {
+        return static_cast<std::size_t>(tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed));
+    }
+
+private:
+    struct record_meta {
+        std::chrono::system_clock::time_point ts;
+        std::thread::id tid;
+        const call_site* site;
+        std::uint64_t seq;
+        const deferred_codec* deferred;
+        std::string_view deferred_fmt;
+        std::string_view name;
+        std::uint32_t payload_len;
+        std::uint32_t origin;
+        level lvl;
+        std::uint32_t fields_len; // field records after the payload (payload_buffer::trailer())
+    };
+    static_assert(std::is_trivially_destructible_v<record_meta>);
+
+    static constexpr std::uint64_t skip_bit = std::uint64_t{1} << 63;
+    static constexpr std::size_t header_size = sizeof(std::uint64_t) + align8(sizeof(record_meta));
+
+    unsigned char* bytes_at(std::uint64_t pos) noexcept {
+        return reinterpret_cast<unsigned char*>(words_.get()) + (static_cast<std::size_t>(pos) & mask_);
+    }
+
+    std::atomic_ref<std::uint64_t> commit_word(std::uint64_t pos) noexcept {
+        return std::atomic_ref<std::uint64_t>(words_[(static_cast<std::size_t>(pos) & mask_) / sizeof(std::uint64_t)]);
+    }
+
+    void commit(std::uint64_t pos, std::uint64_t word) noexcept { commit_word(pos).store(word, std::memory_order_release); }
+
+    bool try_pop(log_event& out) {
+        std::uint64_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            const std::uint64_t word = commit_word(pos).load(std::memory_order_acquire);
+            if (word == 0) return false; // empty (or next record not yet published)
+
+            const std::size_t size = static_cast<std::size_t>(word & ~skip_bit);
+            if (word & skip_bit) {
+                // Only the skip header was written; the rest of the tail is already zero.
+                std::memset(bytes_at(pos), 0, sizeof(std::uint64_t));
+                pos += size;
+                head_.store(pos, std::memory_order_release);
+                continue;
+            }
+
+            unsigned char* p = bytes_at(pos);
+            const auto* meta = std::launder(reinterpret_cast<const record_meta*>(p + sizeof(std::uint64_t)));
+            const char* body = reinterpret_cast<const char*>(p + header_size);
+            out.ts = meta->ts;
+            out.lvl = meta->lvl;
+            out.origin = meta->origin;
+            out.tid = meta->tid;
+            out.seq = meta->seq;
+            out.site = meta->site;
+            out.deferred = meta->deferred;
+            out.deferred_fmt = meta->deferred_fmt;
+            out.name = meta->name;
+            if (meta->fields_len) {
+                char* dst = out.payload.resize(meta->payload_len, meta->fields_len);
+                std::memcpy(dst, body, std::size_t{meta->payload_len} + meta->fields_len);
+            } else {
+                out.payload.assign(body, meta->payload_len);
+            }
+
+            std::memset(p, 0, size);
+            head_.store(pos + size, std::memory_order_release);
+            popped_.store(popped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    std::size_t cap_;
+    std::size_t mask_;
+    std::unique_ptr<std::uint64_t[]> words_;
+
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+    std::atomic<std::uint64_t> popped_{0};
+    alignas(64) std::atomic<std::uint64_t> tail_{0};
+    alignas(64) std::atomic<std::uint64_t> pushed_{0};
+    queue_wait* wait_;
+};
+
+// Lane layout for dual_queue / byte_dual_queue, derived from async_cfg::lanes. Lanes are kept
+// highest priority (highest min_level) first; lane_of maps each level to its lane.
+struct lane_plan {
+    using lane_cfg = logger_config::async_cfg::lane;
+    using schedule_kind = logger_config::async_cfg::lane_schedule;
+
+    std::vector<std::size_t> capacity;
+    std::vector<std::size_t> weight;
+    std::vector<std::chrono::steady_clock::duration> deadline;
+    std::array<std::uint8_t, level_count> lane_of{};
+    schedule_kind schedule = schedule_kind::strict;
+
+    // The historical split: warn+ gets a quarter of the queue, everything else the rest.
+    static std::vector<lane_cfg> default_lanes() {
+        lane_cfg hi;
+        hi.min_level = level::warn;
+        return {hi, lane_cfg{}};
+    }
+
+    static lane_plan make(std::vector<lane_cfg> lanes, std::size_t total, schedule_kind schedule) {
+        if (lanes.empty()) {
+            lanes = default_lanes();
+            lanes[0].capacity = std::max<std::size_t>(1, total / 4);
+        }
+        std::stable_sort(lanes.begin(), lanes.end(), [](const lane_cfg& a, const lane_cfg& b) {
+            return static_cast<int>(a.min_level) > static_cast<int>(b.min_level);
+        });
+        lanes.erase(std::unique(lanes.begin(), lanes.end(),
+                                [](const lane_cfg& a, const lane_cfg& b) { return a.min_level == b.min_level; }),
+                    lanes.end());
+        if (lanes.size() > 255) lanes.resize(255);
+
+        lane_plan plan;
+        plan.schedule = schedule;
+        std::size_t fixed = 0, shared = 0;
+        for (const auto& l : lanes) {
+            fixed += l.capacity;
+            if (l.capacity == 0) ++shared;
+        }
+        const std::size_t rest = total > fixed ? total - fixed : 0;
+        for (const auto& l : lanes) {
+            plan.capacity.push_back(std::max<std::size_t>(1, l.capacity != 0 ? l.capacity : rest / shared));
+            plan.weight.push_back(l.weight != 0 ? l.weight : static_cast<std::size_t>(std::max(1, level_weight(l.min_level))));
+            plan.deadline.push_back(l.deadline);
+        }
+        // Levels below the lowest lane's min_level still go to the lowest lane.
+        for (std::size_t lv = 0; lv < level_count; ++lv) {
+            std::size_t i = 0;
+            while (i + 1 < lanes.size() && static_cast<std::size_t>(lanes[i].min_level) > lv) ++i;
+            plan.lane_of[lv] = static_cast<std::uint8_t>(i);
+        }
+        return plan;
+    }
+
+    std::size_t lane(level lv) const noexcept {
+        return lv == level::off ? lane_of[level_count - 1] : lane_of[static_cast<std::size_t>(lv)];
+    }
+};
+
+// Consumer-side batch filling across lanes according to lane_plan::schedule.
+// pop(i, limit) pops up to `limit` events from lane i and returns how many it got.
+class lane_scheduler {
+public:
+    explicit lane_scheduler(const lane_plan& plan) : plan_(plan), last_served_(plan.capacity.size()) {}
+
+    template <class Pop>
+    std::size_t fill(std::size_t max_batch, Pop&& pop) {
+        using schedule_kind = lane_plan::schedule_kind;
+        const std::size_t lanes = plan_.capacity.size();
+        std::size_t n = 0;
+
+        // A crash drain always goes strictly by priority: warn+ first.
+        const schedule_kind schedule = crash_draining() ? schedule_kind::strict : plan_.schedule;
+        if (schedule == schedule_kind::weighted && lanes > 1) {
+            // Weighted round-robin: every lane gets its share of the batch (at least one slot);
+            // whatever a lane leaves unused is handed out by priority below.
+            std::size_t total_weight = 0;
+            for (auto w : plan_.weight) total_weight += w;
+            for (std::size_t i = 0; i < lanes && n < max_batch; ++i) {
+                const std::size_t quota = std::max<std::size_t>(1, max_batch * plan_.weight[i] / total_weight);
+                n += pop(i, std::min(quota, max_batch - n));
+            }
+        } else if (schedule == schedule_kind::deadline) {
+            // Lanes that haven't been polled within their deadline are served first.
+            const auto now = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < lanes && n < max_batch; ++i) {
+                if (plan_.deadline[i].count() <= 0 || now - last_served_[i] < plan_.deadline[i]) continue;
+                n += pop(i, max_batch - n);
+                last_served_[i] = now;
+            }
+            for (std::size_t i = 0; i < lanes && n < max_batch; ++i) {
+                n += pop(i, max_batch - n);
+                last_served_[i] = now;
+            }
+            return n;
+        }
+
+        for (std::size_t i = 0; i < lanes && n < max_batch; ++i) n += pop(i, max_batch - n);
+        return n;
+    }
+
+private:
+    const lane_plan& plan_;
+    std::vector<std::chrono::steady_clock::time_point> last_served_;
+};
+
+} // namespace detail
+
+// Async queue made of priority lanes (one bounded MPSC ring each), configured through
+// async_cfg::lanes / ::lane_schedule. The default is two lanes: warn+ and everything else.
+template <class T>
+class dual_queue {
+public:
+    using lane_cfg = logger_config::async_cfg::lane;
+    using lane_schedule = logger_config::async_cfg::lane_schedule;
+
+    explicit dual_queue(std::size_t total_cap, std::vector<lane_cfg> lanes = {},
+                        lane_schedule schedule = lane_schedule::strict)
+        : plan_(detail::lane_plan::make(std::move(lanes), total_cap, schedule)),
+          counters_(new detail::ring_counters[plan_.capacity.size()]),
+          scheduler_(plan_) {
+        for (auto cap : plan_.capacity) rings_.push_back(std::make_unique<detail::mpsc_ring<T>>(cap, &wait_));
+    }
+
+    bool try_push(T&& v, level lv) {
+        const std::size_t i = plan_.lane(lv);
+        const bool ok = rings_[i]->try_push(std::move(v));
+        if (!ok) counters_[i].note_rejected();
+        return ok;
+    }
+
+    void push_blocking(T&& v, level lv) {
+        const std::size_t i = plan_.lane(lv);
+        counters_[i].note_blocked();
+        rings_[i]->push_blocking(std::move(v));
+    }
+
+    std::size_t pop_batch(std::vector<T>& out, std::size_t max_batch) {
+        for (std::size_t i = 0; i < rings_.size(); ++i) counters_[i].note_occupancy(rings_[i]->size_relaxed());
+        return scheduler_.fill(max_batch, [&](std::size_t i, std::size_t limit) { return rings_[i]->pop_batch(out, limit); });
+    }
+
+    void wait_for_data(std::chrono::milliseconds dur) {
+        // If producers enqueue while we're sleeping, they will post data_ready.
+        wait_.wait_for_data(dur, [&] { return size_relaxed() > 0; });
+    }
+
+    void signal_stop() { wait_.signal_stop(); }
+    void wake() noexcept { wait_.wake(); }
+
+    std::size_t size_relaxed() const noexcept {
+        std::size_t n = 0;
+        for (const auto& r : rings_) n += r->size_relaxed();
+        return n;
+    }
+
+    void ring_stats(std::vector<chlog::ring_stats>& out) const {
+        for (std::size_t i = 0; i < rings_.size(); ++i)
+            out.push_back(counters_[i].snapshot(rings_[i]->capacity(), rings_[i]->size_relaxed()));
+    }
+
+private:
+    detail::queue_wait wait_;
+    detail::lane_plan plan_;
+    std::vector<std::unique_ptr<detail::mpsc_ring<T>>> rings_;
+    std::unique_ptr<detail::ring_counters[]> counters_;
+    detail::lane_scheduler scheduler_;
+};
+
+// Same lanes as dual_queue, backed by variable-length byte rings (lane capacities in bytes).
+// pop_into() decodes into caller-owned slots so their string buffers are reused.
+class byte_dual_queue {
+public:
+    using lane_cfg = logger_config::async_cfg::lane;
+    using lane_schedule = logger_config::async_cfg::lane_schedule;
+
+    explicit byte_dual_queue(std::size_t total_bytes, std::vector<lane_cfg> lanes = {},
+                             lane_schedule schedule = lane_schedule::strict)
+        : plan_(detail::lane_plan::make(std::move(lanes), total_bytes, schedule)),
+          counters_(new detail::ring_counters[plan_.capacity.size()]),
+          scheduler_(plan_) {
+        for (auto cap : plan_.capacity) rings_.push_back(std::make_unique<detail::byte_ring>(cap, &wait_));
+    }
+
+    bool try_push(const log_event& e, level lv) {
+        const std::size_t i = plan_.lane(lv);
+        const bool ok = rings_[i]->try_push(e);
+        if (!ok) counters_[i].note_rejected();
+        return ok;
+    }
+
+    void push_blocking(const log_event& e, level lv) {
+        const std::size_t i = plan_.lane(lv);
+        counters_[i].note_blocked();
+        rings_[i]->push_blocking(e);
+    }
+
+    // Overwrites out[0..n) (growing `out` as needed) and returns n.
+    std::size_t pop_into(std::vector<log_event>& out, std::size_t max_batch) {
+        for (std::size_t i = 0; i < rings_.size(); ++i) counters_[i].note_occupancy(rings_[i]->used_bytes_relaxed());
+        std::size_t n = 0;
+        return scheduler_.fill(max_batch, [&](std::size_t i, std::size_t limit) {
+            const std::size_t got = rings_[i]->pop_into(out, n, limit);
+            n += got;
+            return got;
+        });
+    }
+
+    void wait_for_data(std::chrono::milliseconds dur) {
+        wait_.wait_for_data(dur, [&] { return size_relaxed() > 0; });
+    }
+
+    void signal_stop() { wait_.signal_stop(); }
+    void wake() noexcept { wait_.wake(); }
+
+    std::size_t size_relaxed() const noexcept {
+        std::size_t n = 0;
+        for (const auto& r : rings_) n += r->size_relaxed();
+        return n;
+    }
+
+    void ring_stats(std::vector<chlog::ring_stats>& out) const {
+        for (std::size_t i = 0; i < rings_.size(); ++i)
+            out.push_back(counters_[i].snapshot(rings_[i]->capacity_bytes(), rings_[i]->used_bytes_relaxed()));
+    }
+
+private:
+    detail::queue_wait wait_;
+    detail::lane_plan plan_;
+    std::vector<std::unique_ptr<detail::byte_ring>> rings_;
+    std::unique_ptr<detail::ring_counters[]> counters_;
+    detail::lane_scheduler scheduler_;
+};
+
+// Alternative async backend: each producer thread lazily registers its own pair of
+// wait-free SPSC rings (hi for warn+, lo for the rest), so producers never contend on a
+// shared tail. The single consumer drains every registered ring; with merge_order::seq /
+// ::timestamp it performs a k-way merge over the ring fronts (best-effort ordering: an
+// older event that is still being published on another thread can't be waited for).
+// Same interface as dual_queue so the two can be A/B'd.
+template <class T>
+class per_thread_queue {
+public:
+    using merge_order = logger_config::async_cfg::merge_order;
+
+    per_thread_queue(std::size_t per_thread_cap, merge_order order)
+        : per_thread_cap_(std::max<std::size_t>(4, per_thread_cap)), order_(order) {}
+
+    ~per_thread_queue() {
+        std::lock_guard<std::mutex> lk(reg_mu_);
+        for (auto& p : registry_) p->closed.store(true, std::memory_order_relaxed);
+    }
+
+    per_thread_queue(const per_thread_queue&) = delete;
+    per_thread_queue& operator=(const per_thread_queue&) = delete;
+
+    bool try_push(T&& v, level lv) {
+        const bool ok = push_local(std::move(v), lv);
+        if (!ok) counters_[is_hi(lv) ? 0 : 1].note_rejected();
+        return ok;
+    }
+
+    void push_blocking(T&& v, level lv) {
+        counters_[is_hi(lv) ? 0 : 1].note_blocked();
+        wait_.push_blocking([&] { return push_local(std::move(v), lv); });
+    }
+
+    std::size_t pop_batch(std::vector<T>& out, std::size_t max_batch) {
+        refresh();
+        std::size_t hi = 0, lo = 0;
+        for (const auto& p : local_) {
+            hi += p->hi.size_relaxed();
+            lo += p->lo.size_relaxed();
+        }
+        counters_[0].note_occupancy(hi);
+        counters_[1].note_occupancy(lo);
+
+        std::size_t n = drain(&producer::hi, out, max_batch);
+        if (n < max_batch) n += drain(&producer::lo, out, max_batch - n);
+
+        if (n > 0) wait_.notify_space();
+        return n;
+    }
+
+    void wait_for_data(std::chrono::milliseconds dur) {
+        // The re-check runs after advertising sleep, so it also picks up rings registered
+        // since the last refresh.
+        wait_.wait_for_data(dur, [&] {
+            if (consumer_size() > 0) return true;
+            refresh();
+            return consumer_size() > 0;
+        });
+    }
+
+    void signal_stop() { wait_.signal_stop(); }
+    void wake() noexcept { wait_.wake(); }
+
+    std::size_t size_relaxed() const {
+        std::lock_guard<std::mutex> lk(reg_mu_);
+        std::size_t n = 0;
+        for (const auto& p : registry_) n += p->hi.size_relaxed() + p->lo.size_relaxed();
+        return n;
+    }
+
+    void ring_stats(std::vector<chlog::ring_stats>& out) const {
+        std::size_t hi = 0, lo = 0, hi_cap = 0, lo_cap = 0;
+        {
+            std::lock_guard<std::mutex> lk(reg_mu_);
+            for (const auto& p : registry_) {
+                hi += p->hi.size_relaxed();
+                lo += p->lo.size_relaxed();
+                hi_cap = p->hi.capacity();
+                lo_cap = p->lo.capacity();
+            }
+        }
+        out.push_back(counters_[0].snapshot(hi_cap, hi));
+        out.push_back(counters_[1].snapshot(lo_cap, lo));
+    }
+
+private:
+    struct producer {
+        explicit producer(std::size_t cap) : hi(std::max<std::size_t>(1, cap / 4)), lo(cap - std::max<std::size_t>(1, cap / 4)) {}
+        detail::spsc_ring<T> hi;
+        detail::spsc_ring<T> lo;
+        std::atomic<bool> closed{false}; // owning queue destroyed
+    };
+
+    static std::uint64_t next_id() noexcept {
+        static std::atomic<std::uint64_t> id{0};
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static constexpr bool is_hi(level lv) noexcept { return static_cast<int>(lv) >= static_cast<int>(level::warn); }
+
+    bool push_local(T&& v, level lv) {
+        if (wait_.stop.load(std::memory_order_relaxed)) return false;
+        producer& p = local_producer();
+        const bool ok = is_hi(lv) ? p.hi.try_push(std::move(v)) : p.lo.try_push(std::move(v));
+        if (!ok) return false;
+
+        // Wake consumer only if it is likely sleeping.
+        wait_.notify_data();
+        return true;
+    }
+
+    producer& local_producer() {
+        // Keyed by queue id (never reused), so an entry can't alias a newer queue at the same address.
+        thread_local std::vector<std::pair<std::uint64_t, std::shared_ptr<producer>>> mine;
+        for (auto& [id, p] : mine) {
+            if (id == id_) return *p;
+        }
+
+        std::erase_if(mine, [](const auto& entry) { return entry.second->closed.load(std::memory_order_relaxed); });
+        auto p = std::make_shared<producer>(per_thread_cap_);
+        {
+            std::lock_guard<std::mutex> lk(reg_mu_);
+            registry_.push_back(p);
+        }
+        version_.fetch_add(1, std::memory_order_release);
+        mine.emplace_back(id_, p);
+        return *p;
+    }
+
+    // Consumer-side view of the registry; refreshed when producers register, and
+    // periodically pruned of rings whose thread has exited and that have been drained.
+    void refresh() {
+        const auto v = version_.load(std::memory_order_acquire);
+        if (v == seen_version_ && ++prune_tick_ < 1024) return;
+        prune_tick_ = 0;
+
+        std::lock_guard<std::mutex> lk(reg_mu_);
+        local_.clear(); // drop our references so use_count() reflects live producer threads
+        std::erase_if(registry_, [](const std::shared_ptr<producer>& p) {
+            return p.use_count() == 1 && p->hi.size_relaxed() == 0 && p->lo.size_relaxed() == 0;
+        });
+        local_ = registry_;
+        seen_version_ = v;
+    }
+
+    std::size_t consumer_size() const noexcept {
+        std::size_t n = 0;
+        for (const auto& p : local_) n += p->hi.size_relaxed() + p->lo.size_relaxed();
+        return n;
+    }
+
+    std::size_t drain(detail::spsc_ring<T> producer::*ring, std::vector<T>& out, std::size_t max_batch) {
+        std::size_t n = 0;
+        if (local_.empty()) return 0;
+
+        if (order_ == merge_order::none) {
+            // Rotate the starting ring so one busy producer can't monopolize every batch.
+            const std::size_t count = local_.size();
+            for (std::size_t i = 0; i < count && n < max_batch; ++i) {
+                auto& r = (*local_[(rr_ + i) % count]).*ring;
+                while (n < max_batch) {
+                    T* v = r.front();
+                    if (!v) break;
+                    out.push_back(std::move(*v));
+                    r.pop();
+                    ++n;
+                }
+            }
+            rr_ = (rr_ + 1) % count;
+            return n;
+        }
+
+        while (n < max_batch) {
+            detail::spsc_ring<T>* best = nullptr;
+            T* best_v = nullptr;
+            for (auto& p : local_) {
+                auto& r = (*p).*ring;
+                T* v = r.front();
+                if (v && (!best_v || earlier(*v, *best_v))) {
+                    best = &r;
+                    best_v = v;
+                }
+            }
+            if (!best) break;
+            out.push_back(std::move(*best_v));
+            best->pop();
+            ++n;
         }
+        return n;
     }
 
-private:
-    void open(const std::string& day) {
-        current_day_ = day;
-        const auto path = dir_ / (day + ".log");
-        file_.open(path, std::ios::out | std::ios::app);
+    bool earlier(const T& a, const T& b) const noexcept {
+        if (order_ == merge_order::timestamp && a.ts != b.ts) return a.ts < b.ts;
+        return a.seq < b.seq;
     }
 
-    void rotate(const std::string& day) {
-        if (file_.is_open()) {
-            file_.flush();
-            file_.close();
-        }
-        open(day);
-    }
+    const std::uint64_t id_ = next_id();
+    std::size_t per_thread_cap_;
+    merge_order order_;
 
-    std::filesystem::path dir_;
-    std::string current_day_;
-    std::ofstream file_;
-    std::mutex m_;
+    detail::queue_wait wait_;
+
+    mutable std::mutex reg_mu_;
+    std::vector<std::shared_ptr<producer>> registry_;
+    alignas(64) std::atomic<std::uint64_t> version_{0};
+
+    // Consumer-only state.
+    alignas(64) std::vector<std::shared_ptr<producer>> local_;
+    std::uint64_t seen_version_ = 0;
+    std::size_t prune_tick_ = 0;
+    std::size_t rr_ = 0;
+
+    detail::ring_counters counters_[2]; // hi, lo (summed over producer threads)
 };
 
-class json_sink : public sink {
+namespace detail {
+
+// Type-erased async queue used by logger so the backend can be picked at runtime
+// (logger_config::async.backend). One virtual call per push is negligible next to the
+// queue's own atomics.
+class event_queue {
 public:
-    explicit json_sink(std::filesystem::path path) : path_(std::move(path)) {
-        if (!path_.parent_path().empty()) {
-            std::filesystem::create_directories(path_.parent_path());
-        }
-        file_.open(path_, std::ios::out | std::ios::app);
-    }
+    virtual ~event_queue() = default;
+    virtual bool try_push(log_event&& e, level lv) = 0;
+    virtual void push_blocking(log_event&& e, level lv) = 0;
+    // Overwrites out[0..n) (growing `out` as needed) and returns n.
+    virtual std::size_t pop_into(std::vector<log_event>& out, std::size_t max_batch) = 0;
+    virtual void wait_for_data(std::chrono::milliseconds dur) = 0;
+    virtual void signal_stop() = 0;
+    // Wakes a parked consumer (the crash handler calls it; see wake_signal::signal_safe).
+    virtual void wake() noexcept = 0;
+    virtual std::size_t size_relaxed() const noexcept = 0;
+    virtual void ring_stats(std::vector<chlog::ring_stats>& out) const = 0;
+};
 
-    void log(const log_event& e) override {
-        if (static_cast<int>(e.lvl) < static_cast<int>(level_)) return;
-        const auto js = std::format(
-            R"({{"ts":"{}","lvl":"{}","tid":"{}","name":"{}","seq":{},"file":"{}","line":{},"func":"{}","msg":"{}"}})",
-            make_timestamp(e.ts),
-            level_name(e.lvl),
-            thread_id_string(e.tid),
-            e.name,
-            e.seq,
-            json_escape(e.loc.file_name()),
-            e.loc.line(),
-            json_escape(e.loc.function_name()),
-            json_escape(e.payload));
+template <class Q>
+class event_queue_impl final : public event_queue {
+public:
+    template <class... A>
+    explicit event_queue_impl(A&&... args) : q_(std::forward<A>(args)...) {}
 
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (!file_.is_open()) return;
-            file_ << js << '\n';
-        } else {
-            if (!file_.is_open()) return;
-            file_ << js << '\n';
-        }
-    }
+    bool try_push(log_event&& e, level lv) override { return q_.try_push(std::move(e), lv); }
+    void push_blocking(log_event&& e, level lv) override { q_.push_blocking(std::move(e), lv); }
 
-    void flush() override {
-        if (thread_safe_) {
-            std::lock_guard<std::mutex> lk(m_);
-            if (file_.is_open()) file_.flush();
+    std::size_t pop_into(std::vector<log_event>& out, std::size_t max_batch) override {
+        if constexpr (requires { q_.pop_into(out, max_batch); }) {
+            return q_.pop_into(out, max_batch);
         } else {
-            if (file_.is_open()) file_.flush();
+            out.clear();
+            return q_.pop_batch(out, max_batch);
         }
     }
 
+    void wait_for_data(std::chrono::milliseconds dur) override { q_.wait_for_data(dur); }
+    void signal_stop() override { q_.signal_stop(); }
+    void wake() noexcept override { q_.wake(); }
+    std::size_t size_relaxed() const noexcept override { return q_.size_relaxed(); }
+    void ring_stats(std::vector<chlog::ring_stats>& out) const override { q_.ring_stats(out); }
+
 private:
-    std::filesystem::path path_;
-    std::ofstream file_;
-    std::mutex m_;
+    Q q_;
 };
 
-// =========================== Lock-free Dual Queue (MPSC, bounded) ===========================
-// Goal: "industrial-grade" async performance.
+} // namespace detail
+
+// =========================== Thread Pool ===========================
+// Work-stealing pool used for sync-mode parallel_sinks.
 //
-// - Multi-producer / single-consumer.
-// - Bounded, lock-free fast path (CAS-based ring, no mutex on try_push/pop).
-// - Two independent rings:
-//   - high priority for warn+
-//   - low priority for trace/debug/info
-//   This reserves capacity so low-priority bursts can't starve warn+.
+// - Tasks live in a small-buffer type-erased wrapper (no std::function allocation for
+//   small captures).
+// - Each worker owns a deque; enqueue() distributes round-robin, idle workers steal from
+//   the others, so there is no single queue mutex that every submission goes through.
+// - Workers only touch the sleep mutex/condvar when there is nothing to run anywhere.
 
 namespace detail {
 
-inline constexpr bool is_pow2(std::size_t x) noexcept { return x != 0 && ((x & (x - 1)) == 0); }
+class small_task {
+public:
+    small_task() noexcept = default;
+
+    template <class F>
+        requires(!std::is_same_v<std::decay_t<F>, small_task>)
+    small_task(F&& f) { // NOLINT(google-explicit-constructor)
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= inline_size && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<Fn>) {
+            new (&storage_) Fn(std::forward<F>(f));
+            ops_ = &inline_ops<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+            ops_ = &heap_ops<Fn>;
+        }
+    }
 
-inline constexpr std::size_t round_up_pow2(std::size_t x) noexcept {
-    if (x <= 1) return 1;
-    --x;
-    for (std::size_t i = 1; i < sizeof(std::size_t) * 8; i <<= 1) x |= (x >> i);
-    return x + 1;
-}
+    small_task(small_task&& o) noexcept : ops_(o.ops_) {
+        if (ops_) {
+            ops_->move(&storage_, &o.storage_);
+            o.ops_ = nullptr;
+        }
+    }
 
-struct queue_wait {
-    std::mutex m;
-    std::condition_variable cv_not_full;
-    // Hint to reduce producer-side cacheline traffic: producers notify only if the
-    // consumer is likely waiting.
-    std::atomic<bool> sleeping{false};
-    // Semaphore used purely as a wakeup mechanism for the single consumer.
-    // counting_semaphore<1> behaves like a binary semaphore and avoids permit buildup.
-    std::counting_semaphore<1> sem_not_empty{0};
-    std::atomic<bool> stop{false};
-};
+    small_task& operator=(small_task&& o) noexcept {
+        if (this != &o) {
+            reset();
+            ops_ = o.ops_;
+            if (ops_) {
+                ops_->move(&storage_, &o.storage_);
+                o.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
 
-template <class T>
-class mpsc_ring {
-public:
-    mpsc_ring(std::size_t cap, queue_wait* wait) : cap_(detail::round_up_pow2(cap)), mask_(cap_ - 1), wait_(wait) {
-        if (!detail::is_pow2(cap_)) {
-            cap_ = detail::round_up_pow2(cap_);
-            mask_ = cap_ - 1;
+    small_task(const small_task&) = delete;
+    small_task& operator=(const small_task&) = delete;
+
+    ~small_task() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+    void operator()() { ops_->invoke(&storage_); }
+
+private:
+    static constexpr std::size_t inline_size = 48;
+
+    struct ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <class Fn>
+    static constexpr ops inline_ops{
+        [](void* p) { (*std::launder(reinterpret_cast<Fn*>(p)))(); },
+        [](void* dst, void* src) noexcept {
+            Fn* f = std::launder(reinterpret_cast<Fn*>(src));
+            new (dst) Fn(std::move(*f));
+            f->~Fn();
+        },
+        [](void* p) noexcept { std::launder(reinterpret_cast<Fn*>(p))->~Fn(); }};
+
+    template <class Fn>
+    static constexpr ops heap_ops{
+        [](void* p) { (**reinterpret_cast<Fn**>(p))(); },
+        [](void* dst, void* src) noexcept { *reinterpret_cast<Fn**>(dst) = *reinterpret_cast<Fn**>(src); },
+        [](void* p) noexcept { delete *reinterpret_cast<Fn**>(p); }};
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
         }
-        buffer_.reset(new cell[cap_]);
-        for (std::size_t i = 0; i < cap_; ++i) buffer_[i].seq.store(i, std::memory_order_relaxed);
     }
 
-    ~mpsc_ring() {
-        // Best-effort drain to destroy remaining elements.
-        T tmp;
-        while (try_pop(tmp)) {
+    alignas(std::max_align_t) unsigned char storage_[inline_size];
+    const ops* ops_ = nullptr;
+};
+
+} // namespace detail
+
+class thread_pool {
+public:
+    explicit thread_pool(std::size_t n) {
+        if (n == 0) n = 1;
+        queues_ = std::make_unique<worker_queue[]>(n);
+        n_ = n;
+        workers_.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            workers_.emplace_back([this, i] { run(i); });
         }
     }
 
-    mpsc_ring(const mpsc_ring&) = delete;
-    mpsc_ring& operator=(const mpsc_ring&) = delete;
+    ~thread_pool() { shutdown(); }
 
-    bool try_push(T&& v) {
-        if (wait_ && wait_->stop.load(std::memory_order_relaxed)) return false;
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
 
-        cell* c = nullptr;
-        std::size_t pos = tail_.load(std::memory_order_relaxed);
-        for (;;) {
-            c = &buffer_[pos & mask_];
-            const std::size_t seq = c->seq.load(std::memory_order_acquire);
-            const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+    template <class F>
+    void enqueue(F&& f) {
+        if (stop_.load(std::memory_order_relaxed)) return;
+        const std::size_t i = next_.fetch_add(1, std::memory_order_relaxed) % n_;
+        // Count first so a worker that grabs the task immediately can't underflow pending_.
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lk(queues_[i].m);
+            queues_[i].tasks.emplace_back(std::forward<F>(f));
+        }
+        if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lk(sleep_mu_);
+            sleep_cv_.notify_one();
+        }
+    }
 
-            if (diff == 0) {
-                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
-            } else if (diff < 0) {
-                return false; // full
-            } else {
-                pos = tail_.load(std::memory_order_relaxed);
-            }
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lk(sleep_mu_);
+            stop_.store(true, std::memory_order_relaxed);
+        }
+        sleep_cv_.notify_all();
+        for (auto& w : workers_) {
+            if (w.joinable()) w.join();
         }
+        workers_.clear();
+    }
 
-        new (&c->storage) T(std::move(v));
-        c->seq.store(pos + 1, std::memory_order_release);
+private:
+    struct alignas(64) worker_queue {
+        std::mutex m;
+        std::deque<detail::small_task> tasks;
+    };
 
-        // Wake consumer only if it is likely sleeping.
-        if (wait_ && wait_->sleeping.exchange(false, std::memory_order_relaxed)) {
-            wait_->sem_not_empty.release();
+    bool try_take(std::size_t self, detail::small_task& out) {
+        // Own queue first (FIFO keeps per-worker submission order), then steal from the back of others.
+        {
+            auto& q = queues_[self];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (!q.tasks.empty()) {
+                out = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
         }
-        return true;
+        for (std::size_t k = 1; k < n_; ++k) {
+            auto& q = queues_[(self + k) % n_];
+            std::unique_lock<std::mutex> lk(q.m, std::try_to_lock);
+            if (!lk.owns_lock() || q.tasks.empty()) continue;
+            out = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
+        }
+        return false;
     }
 
-    void push_blocking(T&& v) {
-        // Blocking is not the hot path; used primarily for warn+ overload cases.
+    void run(std::size_t self) {
+        detail::small_task task;
         for (;;) {
-            if (wait_ && wait_->stop.load(std::memory_order_relaxed)) return;
-            if (try_push(std::move(v))) return;
-
-            if (!wait_) {
-                std::this_thread::yield();
+            if (pending_.load(std::memory_order_acquire) > 0 && try_take(self, task)) {
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                try {
+                    task();
+                } catch (...) {
+                }
+                task = detail::small_task{};
                 continue;
             }
 
-            std::unique_lock<std::mutex> lk(wait_->m);
-            wait_->cv_not_full.wait_for(lk, std::chrono::milliseconds(1), [&] {
-                return wait_->stop.load(std::memory_order_relaxed);
+            std::unique_lock<std::mutex> lk(sleep_mu_);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            sleep_cv_.wait(lk, [&] {
+                return stop_.load(std::memory_order_relaxed) || pending_.load(std::memory_order_seq_cst) > 0;
             });
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            if (stop_.load(std::memory_order_relaxed) && pending_.load(std::memory_order_relaxed) == 0) return;
         }
     }
 
-    std::size_t pop_batch(std::vector<T>& out, std::size_t max_batch) {
-        std::size_t n = 0;
-        T item;
-        while (n < max_batch && try_pop(item)) {
-            out.push_back(std::move(item));
-            ++n;
-        }
+    std::unique_ptr<worker_queue[]> queues_;
+    std::size_t n_ = 0;
+    std::vector<std::thread> workers_;
+
+    alignas(64) std::atomic<std::size_t> next_{0};
+    alignas(64) std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> sleepers_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex sleep_mu_;
+    std::condition_variable sleep_cv_;
+};
+
+// =========================== RCU Cell ===========================
+
+namespace detail {
+
+// Per-thread reader state shared by every rcu_cell. Each thread that ever enters a read section
+// claims one record from a process-wide list (records are reused after their thread exits and
+// never freed), so a read section only writes the thread's own cache line.
+struct rcu_reader {
+    alignas(64) std::atomic<std::uint64_t> epoch{0}; // grace-period count at entry; 0 outside
+    std::atomic<const void*> cell{nullptr};          // outermost cell, or rcu_any_cell() when nested
+    std::atomic<bool> in_use{false};
+    rcu_reader* next = nullptr;
+};
+
+inline std::atomic<rcu_reader*> rcu_readers{nullptr};
+inline std::atomic<std::uint64_t> rcu_epoch{1};
+
+// Marks a thread inside sections of several cells: every writer waits for it.
+inline const void* rcu_any_cell() noexcept { return &rcu_readers; }
 
-        if (n > 0 && wait_) {
-            wait_->cv_not_full.notify_all();
+// The calling thread's read-side state (trivially destructible, so read sections still work in
+// thread_local destructors that run after rcu_reaper has returned the record).
+struct rcu_thread_state {
+    rcu_reader* rec = nullptr;
+    unsigned depth = 0;
+    const void* cell = nullptr;
+};
+inline thread_local rcu_thread_state rcu_this_thread;
+
+// Returns the thread's record to the list when the thread exits.
+struct rcu_reaper {
+    ~rcu_reaper() {
+        rcu_thread_state& t = rcu_this_thread;
+        if (t.rec && t.depth == 0) {
+            t.rec->in_use.store(false, std::memory_order_release);
+            t.rec = nullptr;
         }
+    }
+};
 
-        return n;
+inline rcu_reader* rcu_claim_reader() {
+    thread_local rcu_reaper reaper;
+    (void)reaper;
+    for (rcu_reader* r = rcu_readers.load(std::memory_order_acquire); r; r = r->next) {
+        bool free = false;
+        if (!r->in_use.load(std::memory_order_relaxed) &&
+            r->in_use.compare_exchange_strong(free, true, std::memory_order_acquire))
+            return r;
     }
+    auto* r = new rcu_reader;
+    r->in_use.store(true, std::memory_order_relaxed);
+    r->next = rcu_readers.load(std::memory_order_relaxed);
+    while (!rcu_readers.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return r;
+}
 
-    void wait_for_data(std::chrono::milliseconds dur) {
-        if (!wait_) {
-            std::this_thread::sleep_for(dur);
-            return;
+inline void rcu_enter(const void* cell) {
+    rcu_thread_state& t = rcu_this_thread;
+    if (t.depth++ == 0) {
+        if (!t.rec) t.rec = rcu_claim_reader();
+        t.cell = cell;
+        t.rec->cell.store(cell, std::memory_order_release);
+        t.rec->epoch.store(rcu_epoch.load(std::memory_order_seq_cst), std::memory_order_release);
+    } else if (t.cell != cell && t.cell != rcu_any_cell()) {
+        t.cell = rcu_any_cell();
+        t.rec->cell.store(t.cell, std::memory_order_release);
+    } else {
+        return; // nested in the same cell: already visible to its writers
+    }
+    // Orders the stores above before the caller's load of the value; pairs with the fence in
+    // rcu_synchronize(): a reader that loads the old value is seen by the grace-period scan.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void rcu_leave() noexcept {
+    rcu_thread_state& t = rcu_this_thread;
+    if (--t.depth == 0) t.rec->epoch.store(0, std::memory_order_release);
+}
+
+// Returns once every read section of `cell` that began before the call has ended. Sections that
+// start later see the value the caller already published, so new readers never hold it up.
+inline void rcu_synchronize(const void* cell) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::uint64_t gp = rcu_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    for (rcu_reader* r = rcu_readers.load(std::memory_order_acquire); r; r = r->next) {
+        for (;;) {
+            const std::uint64_t e = r->epoch.load(std::memory_order_acquire);
+            if (e == 0 || e >= gp) break;
+            const void* c = r->cell.load(std::memory_order_acquire);
+            if (c != cell && c != rcu_any_cell()) break;
+            std::this_thread::yield();
         }
-        // Single consumer: sleep using semaphore to reduce overhead vs condition_variable.
-        wait_->sleeping.store(true, std::memory_order_relaxed);
-        if (wait_->stop.load(std::memory_order_relaxed)) {
-            wait_->sleeping.store(false, std::memory_order_relaxed);
-            return;
+    }
+}
+
+// Read-mostly pointer with RCU-style reclamation. Readers pin the current value by marking their
+// thread's rcu_reader record (no shared counter, no refcount on the value, no lock); a writer
+// publishes a replacement and frees the old value once every reader that may still see it has
+// left. Writers must be serialized by the caller and must not run inside a read section of the
+// same cell on the same thread, nor inside nested sections of different cells (that would wait
+// forever).
+template <class T>
+class rcu_cell {
+public:
+    class guard {
+    public:
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+        ~guard() { rcu_leave(); }
+
+        const T* get() const noexcept { return value_; }
+        const T* operator->() const noexcept { return value_; }
+        const T& operator*() const noexcept { return *value_; }
+
+    private:
+        friend class rcu_cell;
+        explicit guard(const rcu_cell* c) {
+            rcu_enter(c);
+            value_ = c->value_.load(std::memory_order_seq_cst);
         }
-        (void)wait_->sem_not_empty.try_acquire_for(dur);
-        wait_->sleeping.store(false, std::memory_order_relaxed);
+
+        const T* value_ = nullptr;
+    };
+
+    explicit rcu_cell(std::unique_ptr<const T> init) noexcept : value_(init.release()) {}
+    rcu_cell(const rcu_cell&) = delete;
+    rcu_cell& operator=(const rcu_cell&) = delete;
+    ~rcu_cell() { delete value_.load(std::memory_order_relaxed); }
+
+    guard read() const { return guard(this); }
+
+    // Writer side (under the caller's writer lock): the current value, without pinning.
+    const T* peek() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+    // Replaces the value; returns after no reader can observe the previous one (then freed).
+    void publish(std::unique_ptr<const T> next) {
+        const T* old = value_.exchange(next.release(), std::memory_order_seq_cst);
+        rcu_synchronize(this);
+        delete old;
     }
 
-    void signal_stop() {
-        if (!wait_) return;
-        wait_->stop.store(true, std::memory_order_relaxed);
-        // Wake consumer if sleeping.
-        wait_->sem_not_empty.release();
-        wait_->cv_not_full.notify_all();
+private:
+    std::atomic<const T*> value_;
+};
+
+} // namespace detail
+
+// =========================== Shared Async Backend ===========================
+
+namespace detail {
+
+inline std::vector<logger_config::async_cfg::lane> queue_lanes(const logger_config::async_cfg& cfg) {
+    if (cfg.weighted_queue) return cfg.lanes;
+    return {logger_config::async_cfg::lane{}}; // one lane for every level
+}
+
+// The queue described by `cfg` (a logger's private queue, or one shard of an async_backend).
+inline std::shared_ptr<event_queue> make_event_queue(const logger_config::async_cfg& cfg) {
+    using backend = logger_config::async_cfg::queue_backend;
+    if (cfg.backend == backend::byte_ring) {
+        const std::size_t bytes = cfg.queue_bytes != 0 ? cfg.queue_bytes : cfg.queue_capacity * sizeof(log_event);
+        return std::make_shared<event_queue_impl<byte_dual_queue>>(bytes, queue_lanes(cfg), cfg.schedule);
     }
+    if (cfg.backend == backend::per_thread)
+        return std::make_shared<event_queue_impl<per_thread_queue<log_event>>>(cfg.per_thread_capacity, cfg.per_thread_merge);
+    return std::make_shared<event_queue_impl<dual_queue<log_event>>>(cfg.queue_capacity, queue_lanes(cfg), cfg.schedule);
+}
 
-    std::size_t size_relaxed() const noexcept {
-        // Approximate size (may transiently include reserved-but-not-published slots).
-        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+// Empty-queue wait according to cfg.wait; `spins` counts consecutive empty polls. Returns true
+// when the thread parked on the queue.
+inline bool idle_wait(const logger_config::async_cfg& cfg, event_queue& q, std::uint32_t& spins,
+                      std::chrono::steady_clock::time_point last_flush, bool dirty) {
+    using wait = logger_config::async_cfg::wait_strategy;
+    const auto strategy = cfg.wait;
+    if (strategy == wait::busy_spin) {
+        cpu_relax();
+        return false;
+    }
+    if (strategy != wait::park && spins < cfg.spin_count) {
+        ++spins;
+        cpu_relax();
+        return false;
+    }
+    if (strategy == wait::spin_yield) {
+        std::this_thread::yield();
+        return false;
     }
-    std::size_t capacity() const noexcept { return cap_; }
 
-private:
-    struct cell {
-        std::atomic<std::size_t> seq{0};
-        alignas(T) unsigned char storage[sizeof(T)];
-    };
+    // Park until the next timed flush is due (nothing to flush => a full period).
+    using namespace std::chrono;
+    const auto every = cfg.flush_every;
+    milliseconds timeout = every.count() > 0 ? every : milliseconds(100);
+    if (dirty && every.count() > 0) {
+        const auto left = ceil<milliseconds>(last_flush + every - steady_clock::now());
+        timeout = std::clamp(left, milliseconds(1), every);
+    }
+    q.wait_for_data(timeout);
+    spins = 0;
+    return true;
+}
 
-    bool try_pop(T& out) {
-        cell* c = nullptr;
-        std::size_t pos = head_.load(std::memory_order_relaxed);
-        for (;;) {
-            c = &buffer_[pos & mask_];
-            const std::size_t seq = c->seq.load(std::memory_order_acquire);
-            const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+// What an async_backend worker calls back into (implemented by logger).
+class async_client {
+public:
+    // Writes batch[first, first + n) -- a run of this client's events -- to its sinks. `whole`:
+    // the run is every live event in `batch` (first == 0), so the client may take the vector.
+    virtual void deliver(std::vector<log_event>& batch, std::size_t first, std::size_t n, bool whole) = 0;
+    virtual void timed_flush() = 0;
 
-            if (diff == 0) {
-                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
-            } else if (diff < 0) {
-                return false; // empty
-            } else {
-                pos = head_.load(std::memory_order_relaxed);
-            }
+protected:
+    ~async_client() = default;
+};
+
+} // namespace detail
+
+// Worker threads and queues shared by many async loggers (logger_config::async.shared_backend),
+// instead of one thread and one set of rings per logger. Each worker owns one queue ("shard")
+// built from `cfg` exactly like a logger's private queue; loggers are spread over the shards
+// round-robin when they attach, so every logger keeps a single consumer and its own ordering.
+// Events carry the submitting logger's routing id, and the worker hands each run of a logger's
+// events to that logger's sinks. Loggers hold the backend alive; it stops its workers once the
+// last logger (and the owner's handle) is gone. A logger shut down or destroyed from one of its
+// sinks on a backend worker unregisters without waiting and releases its handle on another
+// thread; the owner's own handle must not be dropped from there (the worker can't join itself).
+class async_backend {
+public:
+    explicit async_backend(logger_config::async_cfg cfg = {}, std::size_t workers = 1) : cfg_(std::move(cfg)) {
+        const std::size_t n = std::max<std::size_t>(1, workers);
+        shards_.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto sh = std::make_unique<shard>();
+            sh->queue = detail::make_event_queue(cfg_);
+            shards_.push_back(std::move(sh));
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            shard& sh = *shards_[i];
+            sh.worker = std::thread([this, &sh, i] {
+                if (cfg_.worker_cpu >= 0) detail::pin_current_thread(cfg_.worker_cpu + static_cast<int>(i));
+                run(sh);
+            });
         }
+    }
 
-        T* obj = reinterpret_cast<T*>(&c->storage);
-        out = std::move(*obj);
-        obj->~T();
-        c->seq.store(pos + cap_, std::memory_order_release);
-        return true;
+    async_backend(const async_backend&) = delete;
+    async_backend& operator=(const async_backend&) = delete;
+
+    ~async_backend() {
+        stop_.store(true, std::memory_order_relaxed);
+        for (auto& sh : shards_) {
+            sh->queue->signal_stop();
+            if (sh->worker.joinable()) sh->worker.join();
+        }
     }
 
-    std::size_t cap_;
-    std::size_t mask_;
-    std::unique_ptr<cell[]> buffer_;
+    std::size_t worker_count() const noexcept { return shards_.size(); }
+    const logger_config::async_cfg& config() const noexcept { return cfg_; }
 
-    alignas(64) std::atomic<std::size_t> head_{0};
-    alignas(64) std::atomic<std::size_t> tail_{0};
-    queue_wait* wait_;
-};
+private:
+    friend class logger;
 
-} // namespace detail
+    struct client_slot {
+        detail::async_client* client = nullptr;
+        std::uint16_t gen = 0;
+    };
 
-template <class T>
-class dual_queue {
-public:
-    explicit dual_queue(std::size_t total_cap)
-        : wait_(),
-          hi_(std::max<std::size_t>(1, total_cap / 4), &wait_),
-          lo_(std::max<std::size_t>(1, total_cap - std::max<std::size_t>(1, total_cap / 4)), &wait_) {}
+    struct shard {
+        std::shared_ptr<detail::event_queue> queue;
+        std::mutex mu;                    // held by the worker while delivering; attach/detach take it
+        std::vector<client_slot> clients; // indexed by the low 16 bits of log_event::origin
+        std::thread worker;
+        std::atomic<bool> crash_drained{false};
+    };
+
+    struct ticket {
+        std::shared_ptr<detail::event_queue> queue;
+        std::size_t shard = 0;
+        std::uint32_t origin = 0;
+    };
 
-    bool try_push(T&& v, int weight) {
-        if (weight >= 3) return hi_.try_push(std::move(v));
-        return lo_.try_push(std::move(v));
+    // Routing id: slot in the low 16 bits, slot generation in the high 16, so events a detached
+    // logger left behind are never handed to a later logger reusing the slot.
+    static std::uint32_t origin_of(std::size_t slot, std::uint16_t gen) noexcept {
+        return static_cast<std::uint32_t>(gen) << 16 | static_cast<std::uint32_t>(slot);
     }
 
-    void push_blocking(T&& v, int weight) {
-        if (weight >= 3) hi_.push_blocking(std::move(v));
-        else lo_.push_blocking(std::move(v));
+    ticket attach(detail::async_client* c) {
+        const std::size_t i = next_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+        shard& sh = *shards_[i];
+        std::lock_guard<std::mutex> lk(sh.mu);
+        std::size_t slot = 0;
+        while (slot < sh.clients.size() && sh.clients[slot].client) ++slot;
+        if (slot == sh.clients.size()) {
+            if (slot > 0xffff) throw std::length_error("chlog: too many loggers on one async_backend worker");
+            sh.clients.emplace_back();
+        }
+        client_slot& cs = sh.clients[slot];
+        cs.client = c;
+        ++cs.gen;
+        return ticket{sh.queue, i, origin_of(slot, cs.gen)};
     }
 
-    std::size_t pop_batch(std::vector<T>& out, std::size_t max_batch) {
-        std::size_t n = 0;
-        n += hi_.pop_batch(out, max_batch);
-        if (n < max_batch) n += lo_.pop_batch(out, max_batch - n);
-        return n;
+    // True on one of this backend's workers, i.e. inside a sink the backend is calling.
+    bool on_worker_thread() const noexcept {
+        const auto self = std::this_thread::get_id();
+        return std::any_of(shards_.begin(), shards_.end(), [&](const auto& sh) { return sh->worker.get_id() == self; });
     }
 
-    void wait_for_data(std::chrono::milliseconds dur) {
-        if (size_relaxed() > 0) return;
-        wait_.sleeping.store(true, std::memory_order_relaxed);
-        if (wait_.stop.load(std::memory_order_relaxed)) {
-            wait_.sleeping.store(false, std::memory_order_relaxed);
-            return;
-        }
-        // If producers enqueue while we're sleeping, they will release sem_not_empty.
-        (void)wait_.sem_not_empty.try_acquire_for(dur);
-        wait_.sleeping.store(false, std::memory_order_relaxed);
+    // After this returns the worker no longer calls into the client. The shard's own worker
+    // already holds sh.mu whenever it calls into a client.
+    void detach(const ticket& t) {
+        shard& sh = *shards_[t.shard];
+        std::unique_lock<std::mutex> lk(sh.mu, std::defer_lock);
+        if (sh.worker.get_id() != std::this_thread::get_id()) lk.lock();
+        client_slot& cs = sh.clients[t.origin & 0xffff];
+        if (origin_of(t.origin & 0xffff, cs.gen) == t.origin) cs.client = nullptr;
     }
 
-    void signal_stop() {
-        wait_.stop.store(true, std::memory_order_relaxed);
-        wait_.sem_not_empty.release();
-        wait_.cv_not_full.notify_all();
+    // Caller holds sh.mu.
+    static detail::async_client* resolve(shard& sh, std::uint32_t origin) noexcept {
+        const std::size_t slot = origin & 0xffff;
+        if (slot >= sh.clients.size()) return nullptr;
+        const client_slot& cs = sh.clients[slot];
+        return origin_of(slot, cs.gen) == origin ? cs.client : nullptr;
     }
 
-    std::size_t size_relaxed() const noexcept { return hi_.size_relaxed() + lo_.size_relaxed(); }
+    // Hands each run of one logger's events to that logger; remembers who needs a timed flush.
+    static void deliver(shard& sh, std::vector<log_event>& batch, std::size_t n, std::vector<std::uint32_t>& dirty) {
+        std::lock_guard<std::mutex> lk(sh.mu);
+        std::size_t i = 0;
+        while (i < n) {
+            const std::uint32_t origin = batch[i].origin;
+            std::size_t j = i + 1;
+            while (j < n && batch[j].origin == origin) ++j;
+            if (auto* c = resolve(sh, origin)) {
+                c->deliver(batch, i, j - i, i == 0 && j == n);
+                if (std::find(dirty.begin(), dirty.end(), origin) == dirty.end()) dirty.push_back(origin);
+            }
+            i = j;
+        }
+    }
 
-private:
-    detail::queue_wait wait_;
-    detail::mpsc_ring<T> hi_;
-    detail::mpsc_ring<T> lo_;
-};
+    void run(shard& sh) {
+        std::vector<log_event> batch;
+        batch.reserve(cfg_.batch_max);
+        std::vector<std::uint32_t> dirty; // clients written since the last timed flush
+        auto last_flush = std::chrono::steady_clock::now();
+        std::uint32_t spins = 0;
 
-// =========================== Thread Pool ===========================
+        while (!stop_.load(std::memory_order_relaxed)) {
+            if (detail::crash_draining() && !sh.crash_drained.load(std::memory_order_relaxed)) crash_drain(sh, batch, dirty);
+            const std::size_t n = sh.queue->pop_into(batch, cfg_.batch_max);
+            if (n == 0) {
+                detail::idle_wait(cfg_, *sh.queue, spins, last_flush, !dirty.empty());
+            } else {
+                spins = 0;
+                deliver(sh, batch, n, dirty);
+            }
 
-class thread_pool {
-public:
-    explicit thread_pool(std::size_t n) : stop_(false) {
-        if (n == 0) n = 1;
-        workers_.reserve(n);
-        for (std::size_t i = 0; i < n; ++i) {
-            workers_.emplace_back([this] {
-                for (;;) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lk(m_);
-                        cv_.wait(lk, [&] { return stop_ || !tasks_.empty(); });
-                        if (stop_ && tasks_.empty()) return;
-                        task = std::move(tasks_.front());
-                        tasks_.pop();
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_flush >= cfg_.flush_every) {
+                if (!dirty.empty()) {
+                    std::lock_guard<std::mutex> lk(sh.mu);
+                    for (const std::uint32_t origin : dirty) {
+                        if (auto* c = resolve(sh, origin)) c->timed_flush();
                     }
-                    task();
+                    dirty.clear();
                 }
-            });
+                last_flush = now;
+            }
         }
-    }
-
-    ~thread_pool() { shutdown(); }
 
-    void enqueue(std::function<void()> f) {
-        {
-            std::lock_guard<std::mutex> lk(m_);
-            if (stop_) return;
-            tasks_.push(std::move(f));
+        // Drain
+        for (;;) {
+            const std::size_t n = sh.queue->pop_into(batch, cfg_.batch_max);
+            if (n == 0) break;
+            deliver(sh, batch, n, dirty);
         }
-        cv_.notify_one();
     }
 
-    void shutdown() {
-        {
-            std::lock_guard<std::mutex> lk(m_);
-            stop_ = true;
+    // A crash handler is waiting (producers are stopped): deliver what is queued until the
+    // queue is empty or the drain window closes, flush, and report back.
+    void crash_drain(shard& sh, std::vector<log_event>& batch, std::vector<std::uint32_t>& dirty) {
+        while (!detail::crash_deadline_passed()) {
+            const std::size_t n = sh.queue->pop_into(batch, cfg_.batch_max);
+            if (n == 0) break;
+            deliver(sh, batch, n, dirty);
         }
-        cv_.notify_all();
-        for (auto& w : workers_) {
-            if (w.joinable()) w.join();
+        {
+            std::lock_guard<std::mutex> lk(sh.mu);
+            for (const std::uint32_t origin : dirty) {
+                if (auto* c = resolve(sh, origin)) c->timed_flush();
+            }
+            dirty.clear();
         }
-        workers_.clear();
+        sh.crash_drained.store(true, std::memory_order_release);
     }
 
-private:
-    std::vector<std::thread> workers_;
-    std::queue<std::function<void()>> tasks_;
-    std::mutex m_;
-    std::condition_variable cv_;
-    bool stop_;
+    bool crash_drained(std::size_t shard) const noexcept {
+        return shards_[shard]->crash_drained.load(std::memory_order_acquire);
+    }
+
+    logger_config::async_cfg cfg_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<bool> stop_{false};
 };
 
 // =========================== Logger ===========================
 
-class logger {
+class logger : private detail::async_client, private detail::crash_target {
 public:
-    explicit logger(logger_config cfg) : cfg_(std::move(cfg)), seq_(0) {
+    explicit logger(logger_config cfg) : cfg_(std::move(cfg)), name_(detail::intern_name(cfg_.name)), seq_(0) {
         single_threaded_ = cfg_.single_threaded;
         if (single_threaded_) {
-            // Keep the runtime truly single-threaded: no worker thread, no pool.
+            // Keep the runtime truly single-threaded: no worker thread, no pool, no backend.
             cfg_.async.enabled = false;
+            cfg_.async.shared_backend.reset();
             cfg_.parallel_sinks = false;
         }
 
-        if (cfg_.async.enabled) {
-            queue_ = std::make_unique<dual_queue<log_event>>(cfg_.async.queue_capacity);
+        if (cfg_.async.shared_backend) {
+            // Queue and worker settings come from the backend (see async_cfg::shared_backend).
+            const auto& shared = cfg_.async.shared_backend->config();
+            cfg_.async.enabled = true;
+            cfg_.async.batch_max = shared.batch_max;
+            cfg_.async.flush_every = shared.flush_every;
+        }
+
+        deferred_format_ = cfg_.async.enabled && cfg_.async.deferred_format;
+        fanout_ = cfg_.async.enabled && cfg_.async.sink_workers;
+        rate_limited_ = cfg_.rate_limit.burst > 0 || cfg_.rate_limit.sample_one_in > 1;
+        pipeline_ = pipeline_for(cfg_);
+        if (cfg_.latency_histograms) latency_ = std::make_unique<detail::latency_registry>();
+
+        if (cfg_.async.shared_backend) {
+            ticket_ = cfg_.async.shared_backend->attach(this);
+            queue_ = ticket_.queue;
+        } else if (cfg_.async.enabled) {
+            queue_ = detail::make_event_queue(cfg_.async);
             worker_ = std::thread([this] { worker_loop(); });
         }
 
@@ -837,15 +5720,28 @@ public:
             cfg_.capture_logger_name = false;
             cfg_.capture_source_location = false;
         }
+        if (latency_ && cfg_.async.enabled) cfg_.capture_timestamp = true;
+        detail::crash_targets.add(this);
     }
 
-    ~logger() { shutdown(); }
+    ~logger() {
+        detail::crash_targets.remove(this);
+        shutdown();
+        if (fanout_) stop_sink_workers(); // sinks added after shutdown()
+        // Destroyed from a sink on a backend worker: if ours is the last handle, ~async_backend
+        // would join that very worker, so let another thread drop it.
+        auto& backend = cfg_.async.shared_backend;
+        if (backend && backend->on_worker_thread()) std::thread([b = std::move(backend)] {}).detach();
+    }
 
-    void add_sink(std::shared_ptr<sink> s) {
+    // With async.sink_workers, sinks added under the same non-empty `group` share one consumer
+    // thread and an empty group gives the sink a thread of its own; otherwise `group` is ignored.
+    void add_sink(std::shared_ptr<sink> s, std::string_view group = {}) {
         if (single_threaded_) {
             s->set_pattern(cfg_.pattern);
             s->set_thread_safe(false);
             sinks_st_.push_back(std::move(s));
+            refresh_sink_floor();
             return;
         }
 
@@ -853,20 +5749,48 @@ public:
         s->set_pattern(cfg_.pattern);
         s->set_thread_safe(true);
 
-        auto current = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-        if (!current) current = std::make_shared<sink_list>();
-        auto next = std::make_shared<sink_list>(*current);
+        const sink_set& current = *sinks_.peek();
+        auto next = std::make_shared<sink_list>(*current.sinks);
         next->push_back(std::move(s));
-        std::atomic_store_explicit(&sinks_, std::static_pointer_cast<const sink_list>(next), std::memory_order_release);
+        auto owners = current.owners;
+        if (fanout_) owners.push_back(worker_for(group));
+        const std::size_t count = next->size();
+        publish_sinks(std::move(next), std::move(owners));
 
         // NOTE: For peak performance in async mode, we keep sink writes on the single worker thread.
         // The thread_pool is only used for sync-mode parallel_sinks.
         if (!cfg_.async.enabled && cfg_.parallel_sinks && !pool_) {
-            const std::size_t n = (cfg_.sink_pool_size != 0) ? cfg_.sink_pool_size : next->size();
+            const std::size_t n = (cfg_.sink_pool_size != 0) ? cfg_.sink_pool_size : count;
             pool_ = std::make_unique<thread_pool>(n);
         }
     }
 
+    // Detaches `s`; returns false if it was not attached. Once this returns no logging thread or
+    // async worker is inside `s` on behalf of this logger (events already handed to the
+    // parallel_sinks pool may still reach it, and a sink worker may still be finishing a write
+    // that was in progress). Must not be called from inside a sink.
+    bool remove_sink(const std::shared_ptr<sink>& s) {
+        if (single_threaded_) {
+            const auto it = std::find(sinks_st_.begin(), sinks_st_.end(), s);
+            if (it == sinks_st_.end()) return false;
+            sinks_st_.erase(it);
+            refresh_sink_floor();
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lk(sinks_mu_);
+        const sink_set& current = *sinks_.peek();
+        const auto it = std::find(current.sinks->begin(), current.sinks->end(), s);
+        if (it == current.sinks->end()) return false;
+        const auto idx = static_cast<std::size_t>(it - current.sinks->begin());
+        auto next = std::make_shared<sink_list>(*current.sinks);
+        next->erase(next->begin() + static_cast<std::ptrdiff_t>(idx));
+        auto owners = current.owners;
+        if (fanout_) owners.erase(owners.begin() + static_cast<std::ptrdiff_t>(idx));
+        publish_sinks(std::move(next), std::move(owners));
+        return true;
+    }
+
     void set_level(level lv) noexcept { cfg_.level = lv; }
 
     void set_pattern(std::string pat) {
@@ -878,21 +5802,21 @@ public:
 
         std::lock_guard<std::mutex> lk(sinks_mu_);
         cfg_.pattern = std::move(pat);
-        auto current = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-        if (!current) return;
-        for (auto& s : *current) s->set_pattern(cfg_.pattern);
+        for (auto& s : *sinks_.peek()->sinks) s->set_pattern(cfg_.pattern);
     }
 
     void set_flush_on(level lv) noexcept { cfg_.flush_on_level = lv; }
 
     template <class Fmt, class... Args>
     void log(level lv, Fmt&& fmt, Args&&... args)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
                  !(std::is_array_v<std::remove_reference_t<Fmt>> &&
                    std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if (!level_active(lv)) return;
         if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return;
         if (cfg_.capture_source_location) {
-            log_at(lv, std::source_location::current(), std::string_view(fmt), std::forward<Args>(args)...);
+            static const call_site here{std::source_location::current(), level::off, {}, true};
+            log_at(lv, &here, std::string_view(fmt), std::forward<Args>(args)...);
         } else {
             log_at_no_loc(lv, std::string_view(fmt), std::forward<Args>(args)...);
         }
@@ -900,474 +5824,1040 @@ public:
 
     // Fast path for compile-time checked format strings (avoids std::vformat).
     template <class... Args>
-    void log(level lv, std::format_string<Args...> fmt, Args&&... args) {
+    void log(level lv, std::format_string<Args...> fmt, Args&&... args)
+        requires(!detail::field_list<Args...>) {
+        if (!level_active(lv)) return;
         if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return;
         if (cfg_.capture_source_location) {
-            log_at(lv, std::source_location::current(), fmt, std::forward<Args>(args)...);
+            static const call_site here{std::source_location::current(), level::off, {}, true};
+            log_at(lv, &here, fmt, std::forward<Args>(args)...);
         } else {
             log_at_no_loc(lv, fmt, std::forward<Args>(args)...);
         }
     }
 
+    // Structured call: `msg` is taken verbatim (no placeholders) and every kv() argument becomes a
+    // typed field of the event (see Structured Fields); nothing is formatted on this thread.
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void log(level lv, std::string_view msg, Fields&&... fields) {
+        if (!level_active(lv)) return;
+        if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return;
+        if (cfg_.capture_source_location) {
+            static const call_site here{std::source_location::current(), level::off, {}, true};
+            log_at(lv, &here, msg, std::forward<Fields>(fields)...);
+        } else {
+            log_at_no_loc(lv, msg, std::forward<Fields>(fields)...);
+        }
+    }
+
+    // Explicit source locations are interned into a process-wide call_site table (with a small
+    // per-thread cache in front); prefer the CHLOG_* macros, which resolve their call_site statically.
     template <class Fmt, class... Args>
     void log_at(level lv, const std::source_location& loc, Fmt&& fmt, Args&&... args)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
                  !(std::is_array_v<std::remove_reference_t<Fmt>> &&
                    std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return;
+        if (!accepts(lv)) return;
+        log_at(lv, detail::intern_site(loc), std::string_view(fmt), std::forward<Args>(args)...);
+    }
 
-        log_event e;
-        if (cfg_.capture_timestamp) e.ts = std::chrono::system_clock::now();
-        e.lvl = lv;
-        if (cfg_.capture_thread_id) e.tid = std::this_thread::get_id();
-        if (cfg_.capture_logger_name) e.name = cfg_.name;
-        e.loc = loc;
-        try {
-            e.payload = detail::vformat_payload(std::string_view(fmt), std::forward<Args>(args)...);
-        } catch (...) {
-            // Keep logging non-fatal even if formatting fails.
-            e.payload = std::string(std::string_view(fmt));
-        }
+    template <class... Args>
+    void log_at(level lv, const std::source_location& loc, std::format_string<Args...> fmt, Args&&... args)
+        requires(!detail::field_list<Args...>) {
+        if (!accepts(lv)) return;
+        // Not via log_at(call_site*): one location may be reached with many format strings.
+        submit(lv, detail::intern_site(loc), [&](log_event& e) { fill_payload(e, fmt, std::forward<Args>(args)...); });
+    }
+
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void log_at(level lv, const std::source_location& loc, std::string_view msg, Fields&&... fields) {
+        if (!accepts(lv)) return;
+        log_at(lv, detail::intern_site(loc), msg, std::forward<Fields>(fields)...);
+    }
+
+    template <class Fmt, class... Args>
+    void log_at(level lv, const call_site* site, Fmt&& fmt, Args&&... args)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if (!accepts(lv)) return;
+        submit(lv, site, [&](log_event& e) { fill_payload_runtime(e, std::string_view(fmt), std::forward<Args>(args)...); });
+    }
+
+    template <class... Args>
+    void log_at(level lv, const call_site* site, std::format_string<Args...> fmt, Args&&... args)
+        requires(!detail::field_list<Args...>) {
+        if (!accepts(lv)) return;
+        if (site && !site->shared) site->fmt.record(fmt.get());
+        submit(lv, site, [&](log_event& e) { fill_payload(e, fmt, std::forward<Args>(args)...); });
+    }
+
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void log_at(level lv, const call_site* site, std::string_view msg, Fields&&... fields) {
+        if (!accepts(lv)) return;
+        submit(lv, site, [&](log_event& e) { fill_fields(e, msg, fields...); });
+    }
+
+    // NOTE: capture_source_location is intentionally avoided on this path (and so is rate
+    // limiting, which is keyed by call site).
+    template <class Fmt, class... Args>
+    void log_at_no_loc(level lv, Fmt&& fmt, Args&&... args)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if (!accepts(lv)) return;
+        submit(lv, nullptr, [&](log_event& e) { fill_payload_runtime(e, std::string_view(fmt), std::forward<Args>(args)...); });
+    }
+
+    template <class... Args>
+    void log_at_no_loc(level lv, std::format_string<Args...> fmt, Args&&... args)
+        requires(!detail::field_list<Args...>) {
+        if (!accepts(lv)) return;
+        submit(lv, nullptr, [&](log_event& e) { fill_payload(e, fmt, std::forward<Args>(args)...); });
+    }
+
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void log_at_no_loc(level lv, std::string_view msg, Fields&&... fields) {
+        if (!accepts(lv)) return;
+        submit(lv, nullptr, [&](log_event& e) { fill_fields(e, msg, fields...); });
+    }
+
+    template <class... Args>
+    void trace(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::trace)) log(level::trace, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void trace(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::trace)) log(level::trace, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void trace(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::trace)) log(level::trace, msg, std::forward<Fields>(f)...);
+    }
+
+    template <class... Args>
+    void debug(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::debug)) log(level::debug, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void debug(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::debug)) log(level::debug, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void debug(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::debug)) log(level::debug, msg, std::forward<Fields>(f)...);
+    }
+
+    template <class... Args>
+    void info(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::info)) log(level::info, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void info(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::info)) log(level::info, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void info(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::info)) log(level::info, msg, std::forward<Fields>(f)...);
+    }
+
+    template <class... Args>
+    void warn(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::warn)) log(level::warn, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void warn(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::warn)) log(level::warn, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void warn(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::warn)) log(level::warn, msg, std::forward<Fields>(f)...);
+    }
+
+    template <class... Args>
+    void error(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::error)) log(level::error, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void error(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::error)) log(level::error, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void error(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::error)) log(level::error, msg, std::forward<Fields>(f)...);
+    }
+
+    template <class... Args>
+    void critical(std::format_string<Args...> f, Args&&... a)
+        requires(!detail::field_list<Args...>) {
+        if constexpr (level_active(level::critical)) log(level::critical, f, std::forward<Args>(a)...);
+    }
+    template <class Fmt, class... Args>
+    void critical(Fmt&& f, Args&&... a)
+        requires(std::is_convertible_v<Fmt, std::string_view> && !detail::field_list<Args...> &&
+                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
+                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
+        if constexpr (level_active(level::critical)) log(level::critical, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    }
+    template <class... Fields>
+        requires detail::field_list<Fields...>
+    void critical(std::string_view msg, Fields&&... f) {
+        if constexpr (level_active(level::critical)) log(level::critical, msg, std::forward<Fields>(f)...);
+    }
+
+    // Also reports the rate limiter's pending suppression counts (logger_config::rate_limit).
+    void flush() {
+        if (rate_limited_) report_suppressed();
+        flush_sinks();
+    }
+
+    void shutdown() {
         if (single_threaded_) {
-            e.seq = seq_st_++;
-            sink_batch_write_one(e);
-            ++enqueued_st_;
-            ++dequeued_st_;
-            if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
+            flush();
             return;
         }
 
-        e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+        // Before stop_requested_: the worker only drains what is queued once it sees the flag.
+        if (rate_limited_ && !stop_requested_.load(std::memory_order_relaxed) &&
+            !(cfg_.async.shared_backend && cfg_.async.shared_backend->on_worker_thread()))
+            report_suppressed();
 
-        if (cfg_.async.enabled) {
-            const int w = level_weight(lv);
-            const bool ok = queue_->try_push(std::move(e), w);
-            if (ok) {
-                stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-            } else {
-                if (cfg_.async.drop_when_full) {
-                    if (static_cast<int>(lv) >= static_cast<int>(level::warn)) {
-                        queue_->push_blocking(std::move(e), w);
-                        stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
+        bool expected = false;
+        if (!stop_requested_.compare_exchange_strong(expected, true)) return;
+
+        if (worker_.joinable()) {
+            queue_->signal_stop();
+            worker_.join();
+        }
+        if (cfg_.async.shared_backend) {
+            // Let the backend deliver what this logger already enqueued, then unregister; events
+            // submitted afterwards are discarded by the backend worker. On a backend worker (a
+            // sink shutting its own logger down) the events may sit behind the running batch, so
+            // unregister right away and let the backend discard them.
+            auto& backend = *cfg_.async.shared_backend;
+            if (!backend.on_worker_thread()) await_backend_drain();
+            backend.detach(ticket_);
+        }
+        if (fanout_) stop_sink_workers();
+
+        if (pool_) pool_->shutdown();
+        flush_sinks();
+    }
+
+    metrics_snapshot stats() const {
+        metrics_snapshot snap;
+        if (single_threaded_) {
+            snap.dropped = dropped_st_;
+            snap.enqueued = enqueued_st_;
+            snap.dequeued = dequeued_st_;
+            snap.flushed = flushed_st_;
+            snap.queue_size = 0;
+            report_sinks(sinks_st_, snap);
+            if (latency_) latency_->snapshot(snap);
+            return snap;
+        }
+        snap.dropped = stats_.dropped.load(std::memory_order_relaxed);
+        snap.enqueued = stats_.enqueued.load(std::memory_order_relaxed);
+        snap.dequeued = stats_.dequeued.load(std::memory_order_relaxed);
+        snap.flushed = stats_.flushed.load(std::memory_order_relaxed);
+        snap.queue_size = cfg_.async.enabled && queue_ ? queue_->size_relaxed() : 0;
+        for (std::size_t i = 0; i < level_count; ++i)
+            snap.dropped_by_level[i] = stats_.dropped_by_level[i].load(std::memory_order_relaxed);
+        snap.blocked = stats_.blocked.load(std::memory_order_relaxed);
+        if (cfg_.async.enabled && queue_) queue_->ring_stats(snap.rings);
+        {
+            const auto sinks = sinks_.read();
+            for (const auto& w : sinks->workers) snap.sink_queues.push_back(w->stats());
+            report_sinks(*sinks->sinks, snap);
+        }
+        if (latency_) latency_->snapshot(snap);
+        return snap;
+    }
+
+private:
+    using sink_list = std::vector<std::shared_ptr<sink>>;
+
+    static void report_sinks(const sink_list& sinks, metrics_snapshot& snap) {
+        for (const auto& s : sinks) {
+            sink_stats st;
+            if (s->report(st)) snap.sinks.push_back(std::move(st));
+        }
+    }
+
+    // Consumer thread for one sink group (async.sink_workers). The main worker offers slices of
+    // shared, immutable batches; this thread writes them to its sinks and runs their timed
+    // flushes, so a stalled sink only fills (and then drops from) its own queue.
+    class fanout_worker {
+    public:
+        struct slice {
+            std::shared_ptr<const std::vector<log_event>> batch;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            bool flush = false; // flush the group after writing (flush_on_level / shutdown)
+        };
+
+        struct group {
+            sink_list sinks;
+            std::vector<std::size_t> ids; // each sink's position in the logger's list (sink_write_ns)
+        };
+
+        explicit fanout_worker(logger& owner) : owner_(owner) { thread_ = std::thread([this] { run(); }); }
+        fanout_worker(const fanout_worker&) = delete;
+        fanout_worker& operator=(const fanout_worker&) = delete;
+        ~fanout_worker() {
+            stop();
+            join();
+        }
+
+        // Slices dequeued from now on go to `g` (an empty group discards them).
+        void assign(std::shared_ptr<const group> g) {
+            std::lock_guard<std::mutex> lk(mu_);
+            group_ = std::move(g);
+        }
+
+        void offer(slice s) {
+            const std::size_t n = s.end - s.begin;
+            const auto& cfg = owner_.cfg_.async;
+            std::unique_lock<std::mutex> lk(mu_);
+            if (!q_.empty() && queued_ + n > cfg.sink_queue_capacity) {
+                if (cfg.sink_drop_when_full || stop_) {
+                    dropped_ += n;
+                    return;
+                }
+                ++blocked_;
+                space_cv_.wait(lk, [&] { return stop_ || q_.empty() || queued_ + n <= cfg.sink_queue_capacity; });
+            }
+            if (stop_) { // retired (or shutting down) while we waited: its thread may be gone
+                dropped_ += n;
+                return;
+            }
+            queued_ += n;
+            unwritten_.fetch_add(n, std::memory_order_relaxed);
+            high_watermark_ = std::max(high_watermark_, queued_);
+            q_.push_back(std::move(s));
+            lk.unlock();
+            data_cv_.notify_one();
+        }
+
+        // Events offered but not yet written (lock-free; read by the crash handler).
+        std::size_t unwritten() const noexcept { return unwritten_.load(std::memory_order_acquire); }
+
+        ring_stats stats() const {
+            std::lock_guard<std::mutex> lk(mu_);
+            return ring_stats{owner_.cfg_.async.sink_queue_capacity, queued_, high_watermark_, dropped_, blocked_};
+        }
+
+        // The thread drains what is already queued, flushes, and exits.
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                stop_ = true;
+            }
+            data_cv_.notify_all();
+            space_cv_.notify_all();
+        }
+
+        void join() {
+            if (thread_.joinable()) thread_.join();
+        }
+
+    private:
+        void run() {
+            const auto every = owner_.cfg_.async.flush_every;
+            auto last_flush = std::chrono::steady_clock::now();
+            bool dirty = false;
+            std::unique_lock<std::mutex> lk(mu_);
+            for (;;) {
+                if (q_.empty()) {
+                    if (stop_) break;
+                    if (dirty) {
+                        data_cv_.wait_until(lk, last_flush + every);
                     } else {
-                        stats_.dropped.fetch_add(1, std::memory_order_relaxed);
+                        data_cv_.wait(lk, [&] { return stop_ || !q_.empty(); });
                     }
-                } else {
-                    queue_->push_blocking(std::move(e), w);
-                    stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
+                }
+                std::optional<slice> s;
+                if (!q_.empty()) {
+                    s = std::move(q_.front());
+                    q_.pop_front();
+                    queued_ -= s->end - s->begin;
+                }
+                const auto g = group_;
+                lk.unlock();
+
+                if (s) {
+                    space_cv_.notify_one();
+                    write(*g, *s);
+                    unwritten_.fetch_sub(s->end - s->begin, std::memory_order_release);
+                    dirty = true;
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (dirty && ((s && s->flush) || now - last_flush >= every)) {
+                    owner_.sink_flush_all(g->sinks);
+                    dirty = false;
+                    last_flush = now;
+                }
+                lk.lock();
+            }
+            if (dirty) owner_.sink_flush_all(group_->sinks);
+        }
+
+        void write(const group& g, const slice& s) {
+            const std::span<const log_event> events(s.batch->data() + s.begin, s.end - s.begin);
+            for (std::size_t i = 0; i < g.sinks.size(); ++i) {
+                try {
+                    detail::timed(owner_.sink_timer(g.ids[i]), [&] { g.sinks[i]->log_batch(events); });
+                } catch (...) {
                 }
             }
-            return;
         }
 
-        // Sync mode
-        sink_batch_write_one(e);
-        if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
-    }
-
-    template <class... Args>
-    void log_at(level lv, const std::source_location& loc, std::format_string<Args...> fmt, Args&&... args) {
-        if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return;
+        logger& owner_;
+        mutable std::mutex mu_;
+        std::condition_variable data_cv_;
+        std::condition_variable space_cv_;
+        std::deque<slice> q_;
+        std::shared_ptr<const group> group_ = std::make_shared<const group>();
+        std::size_t queued_ = 0;
+        std::size_t high_watermark_ = 0;
+        std::size_t dropped_ = 0;
+        std::size_t blocked_ = 0;
+        std::atomic<std::size_t> unwritten_{0};
+        bool stop_ = false;
+        std::thread thread_;
+    };
 
-        log_event e;
-        if (cfg_.capture_timestamp) e.ts = std::chrono::system_clock::now();
-        e.lvl = lv;
-        if (cfg_.capture_thread_id) e.tid = std::this_thread::get_id();
-        if (cfg_.capture_logger_name) e.name = cfg_.name;
-        e.loc = loc;
-        try {
-            e.payload = detail::format_payload(fmt, std::forward<Args>(args)...);
-        } catch (...) {
-            // Keep logging non-fatal even if formatting fails.
-            e.payload = std::string(fmt.get());
-        }
+    // What readers of sinks_ see. The list is shared so parallel_sinks jobs can keep it alive
+    // past the read section. With sink workers, owners[i] is the worker that writes sinks[i] and
+    // `workers` lists each of them once.
+    struct sink_set {
+        std::shared_ptr<const sink_list> sinks;
+        std::vector<std::shared_ptr<fanout_worker>> owners;
+        std::vector<std::shared_ptr<fanout_worker>> workers;
+    };
 
+    // Logger level plus the pre-format filter: nothing is formatted for a level that no attached
+    // sink would accept. The lowest sink threshold is cached and recomputed when sinks are
+    // added/removed or some sink's level changes; sinks without sink::static_level() pin it at
+    // trace, so they always get to see every event the logger level lets through.
+    bool accepts(level lv) {
+        if (static_cast<int>(lv) < static_cast<int>(cfg_.level)) return false;
+        if (static_cast<int>(lv) >= sink_floor_.load(std::memory_order_relaxed)) return true;
+        if (sink_floor_gen_.load(std::memory_order_relaxed) == detail::sink_levels_changed.load(std::memory_order_relaxed))
+            return false;
         if (single_threaded_) {
-            e.seq = seq_st_++;
-            sink_batch_write_one(e);
-            ++enqueued_st_;
-            ++dequeued_st_;
-            if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
-            return;
+            refresh_sink_floor();
+        } else {
+            std::lock_guard<std::mutex> lk(sinks_mu_);
+            refresh_sink_floor();
         }
+        return static_cast<int>(lv) >= sink_floor_.load(std::memory_order_relaxed);
+    }
 
-        e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+    // Recomputes the lowest sink threshold (level::off without sinks). Outside single-threaded
+    // mode the caller holds sinks_mu_.
+    void refresh_sink_floor() {
+        const std::uint64_t gen = detail::sink_levels_changed.load(std::memory_order_acquire);
+        const sink_list& sinks = single_threaded_ ? sinks_st_ : *sinks_.peek()->sinks;
+        int floor = static_cast<int>(level::off);
+        for (const auto& s : sinks) {
+            const level lv = s->static_level() ? s->level_threshold() : level::trace;
+            floor = std::min(floor, static_cast<int>(lv));
+        }
+        sink_floor_.store(floor, std::memory_order_relaxed);
+        sink_floor_gen_.store(gen, std::memory_order_relaxed);
+    }
 
-        if (cfg_.async.enabled) {
-            const int w = level_weight(lv);
-            const bool ok = queue_->try_push(std::move(e), w);
-            if (ok) {
-                stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-            } else {
-                if (cfg_.async.drop_when_full) {
-                    if (static_cast<int>(lv) >= static_cast<int>(level::warn)) {
-                        queue_->push_blocking(std::move(e), w);
-                        stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                    } else {
-                        stats_.dropped.fetch_add(1, std::memory_order_relaxed);
-                    }
-                } else {
-                    queue_->push_blocking(std::move(e), w);
-                    stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                }
+    // Caller holds sinks_mu_. Regroups the sink workers, then waits for readers of the previous
+    // list before returning. Workers left without sinks are stopped.
+    void publish_sinks(std::shared_ptr<const sink_list> next, std::vector<std::shared_ptr<fanout_worker>> owners) {
+        std::vector<std::shared_ptr<fanout_worker>> workers;
+        for (std::size_t i = 0; i < owners.size(); ++i) {
+            if (std::find(workers.begin(), workers.end(), owners[i]) != workers.end()) continue;
+            auto g = std::make_shared<fanout_worker::group>();
+            for (std::size_t j = i; j < owners.size(); ++j) {
+                if (owners[j] != owners[i]) continue;
+                g->sinks.push_back((*next)[j]);
+                g->ids.push_back(j);
             }
-            return;
+            owners[i]->assign(std::move(g));
+            workers.push_back(owners[i]);
+        }
+        for (const auto& w : sinks_.peek()->workers) {
+            if (std::find(workers.begin(), workers.end(), w) == workers.end()) retire_worker(w);
         }
 
-        // Sync mode
-        sink_batch_write_one(e);
-        if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
+        sinks_.publish(std::make_unique<const sink_set>(sink_set{std::move(next), std::move(owners), std::move(workers)}));
+        refresh_sink_floor();
     }
 
-    template <class Fmt, class... Args>
-    void log_at_no_loc(level lv, Fmt&& fmt, Args&&... args)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        // NOTE: capture_source_location is intentionally avoided on this path.
-        log_event e;
-        if (cfg_.capture_timestamp) e.ts = std::chrono::system_clock::now();
-        e.lvl = lv;
-        if (cfg_.capture_thread_id) e.tid = std::this_thread::get_id();
-        if (cfg_.capture_logger_name) e.name = cfg_.name;
-        try {
-            e.payload = detail::vformat_payload(std::string_view(fmt), std::forward<Args>(args)...);
-        } catch (...) {
-            e.payload = std::string(std::string_view(fmt));
+    // Caller holds sinks_mu_.
+    std::shared_ptr<fanout_worker> worker_for(std::string_view group) {
+        if (group.empty()) return std::make_shared<fanout_worker>(*this);
+        const auto it = named_workers_.find(group);
+        if (it != named_workers_.end()) return it->second;
+        auto w = std::make_shared<fanout_worker>(*this);
+        named_workers_.emplace(std::string(group), w);
+        return w;
+    }
+
+    // Caller holds sinks_mu_. Joined in stop_sink_workers().
+    void retire_worker(const std::shared_ptr<fanout_worker>& w) {
+        w->assign(std::make_shared<const fanout_worker::group>());
+        w->stop();
+        std::erase_if(named_workers_, [&](const auto& kv) { return kv.second == w; });
+        retired_workers_.push_back(w);
+    }
+
+    void stop_sink_workers() {
+        std::vector<std::shared_ptr<fanout_worker>> workers;
+        {
+            std::lock_guard<std::mutex> lk(sinks_mu_);
+            workers = sinks_.peek()->workers;
+            workers.insert(workers.end(), retired_workers_.begin(), retired_workers_.end());
+            retired_workers_.clear();
         }
+        for (auto& w : workers) w->stop();
+        for (auto& w : workers) w->join();
+    }
 
-        if (single_threaded_) {
-            e.seq = seq_st_++;
-            sink_batch_write_one(e);
-            ++enqueued_st_;
-            ++dequeued_st_;
-            if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
-            return;
+    // Sink-worker delivery: moves batch[first, first + n) into a shared block (taking the vector
+    // itself when `whole`) and offers each worker slices of it, split after events that require
+    // a flush (and flushed at the end when `flush_last`).
+    void fan_out(std::vector<log_event>& batch, std::size_t first, std::size_t n, bool whole,
+                 const std::vector<std::shared_ptr<fanout_worker>>& workers, bool flush_last) {
+        std::shared_ptr<const std::vector<log_event>> shared;
+        if (whole) {
+            batch.resize(n);
+            shared = std::make_shared<const std::vector<log_event>>(std::move(batch));
+            batch = std::vector<log_event>();
+            batch.reserve(cfg_.async.batch_max);
+        } else {
+            const auto it = batch.begin() + static_cast<std::ptrdiff_t>(first);
+            shared = std::make_shared<const std::vector<log_event>>(std::make_move_iterator(it),
+                                                                    std::make_move_iterator(it + static_cast<std::ptrdiff_t>(n)));
         }
 
-        e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+        const auto offer = [&](std::size_t begin, std::size_t end, bool flush) {
+            for (const auto& w : workers) w->offer(fanout_worker::slice{shared, begin, end, flush});
+        };
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (static_cast<int>((*shared)[i].lvl) >= static_cast<int>(cfg_.flush_on_level)) {
+                offer(start, i + 1, true);
+                start = i + 1;
+            }
+        }
+        if (start < n) offer(start, n, flush_last);
+    }
 
-        if (cfg_.async.enabled) {
-            const int w = level_weight(lv);
-            const bool ok = queue_->try_push(std::move(e), w);
-            if (ok) {
-                stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-            } else {
-                if (cfg_.async.drop_when_full) {
-                    if (static_cast<int>(lv) >= static_cast<int>(level::warn)) {
-                        queue_->push_blocking(std::move(e), w);
-                        stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                    } else {
-                        stats_.dropped.fetch_add(1, std::memory_order_relaxed);
-                    }
-                } else {
-                    queue_->push_blocking(std::move(e), w);
-                    stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                }
+    // Rate-limit check for one call (see logger_config::rate_limit). Emits the pending
+    // suppression summary for the site when its window rolls over.
+    bool admit(level lv, const call_site* site) {
+        if (!site || site->shared || static_cast<int>(lv) >= static_cast<int>(cfg_.rate_limit.below)) return true;
+
+        const auto& rl = cfg_.rate_limit;
+        const auto v = site->limiter.admit(rl.burst, rl.period, rl.sample_one_in);
+        if (v.suppressed > 0) {
+            // Built like take_summaries(): the site's recorded format must stay its own.
+            log_event e = make_event(lv, site);
+            fill_payload_runtime(e, "suppressed {} messages from this call site", v.suppressed);
+            dispatch(std::move(e));
+        }
+        if (v.first_suppressed) {
+            std::lock_guard<std::mutex> lk(suppressed_mu_);
+            suppressed_sites_.emplace_back(site, lv);
+            suppressed_pending_.store(true, std::memory_order_relaxed);
+        }
+        return v.pass;
+    }
+
+    // Summary events for the sites in suppressed_sites_ with unreported counts: all of them, or
+    // (due_only) those whose window is over; the others stay listed. A site whose count was
+    // already reported by its next call is dropped from the list.
+    std::vector<log_event> take_summaries(bool due_only) {
+        std::vector<log_event> out;
+        std::lock_guard<std::mutex> lk(suppressed_mu_);
+        const std::int64_t now = detail::site_limiter::clock_ns();
+        std::erase_if(suppressed_sites_, [&](const std::pair<const call_site*, level>& p) {
+            auto& limiter = p.first->limiter;
+            if (due_only && !limiter.window_over(now)) return false;
+            if (const std::uint64_t n = limiter.take_suppressed()) {
+                out.push_back(make_event(p.second, p.first));
+                fill_payload_runtime(out.back(), "suppressed {} messages from this call site", n);
             }
-            return;
+            return true;
+        });
+        suppressed_pending_.store(!suppressed_sites_.empty(), std::memory_order_relaxed);
+        return out;
+    }
+
+    // flush()/shutdown(): the summaries go through the normal pipeline.
+    void report_suppressed() {
+        if (!suppressed_pending_.load(std::memory_order_relaxed)) return;
+        for (auto& e : take_summaries(false)) dispatch(std::move(e));
+    }
+
+    // Timed flush, on the worker: summaries of finished windows are written straight to the
+    // sinks (the worker must not wait on its own queue).
+    void write_due_summaries() {
+        if (!suppressed_pending_.load(std::memory_order_relaxed)) return;
+        auto events = take_summaries(true);
+        if (events.empty()) return;
+        for (auto& e : events) {
+            e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+            e.origin = ticket_.origin;
         }
+        stats_.enqueued.fetch_add(events.size(), std::memory_order_relaxed); // write_out counts them dequeued
+        write_out(events, 0, events.size(), true, false);
+    }
 
-        sink_batch_write_one(e);
-        if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
+    // Slow paths of an async push that found the queue full.
+    void push_blocked(log_event&& e, level lv) {
+        stats_.blocked.fetch_add(1, std::memory_order_relaxed);
+        queue_->push_blocking(std::move(e), lv);
+        stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
     }
 
-    template <class... Args>
-    void log_at_no_loc(level lv, std::format_string<Args...> fmt, Args&&... args) {
+    void count_drop(level lv) noexcept {
+        stats_.dropped.fetch_add(1, std::memory_order_relaxed);
+        stats_.dropped_by_level[static_cast<std::size_t>(lv)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // How an event leaves the calling thread; fixed at construction (see pipeline_for).
+    enum class pipeline : std::uint8_t { single_threaded, sync, async_drop, async_block };
+
+    static pipeline pipeline_for(const logger_config& cfg) noexcept {
+        if (cfg.single_threaded) return pipeline::single_threaded;
+        if (!cfg.async.enabled) return pipeline::sync;
+        return cfg.async.drop_when_full ? pipeline::async_drop : pipeline::async_block;
+    }
+
+    // Front half of every log call: rate limit, capture metadata, build the payload. Only this
+    // part is instantiated per format/argument list; the enqueue tail is shared (dispatch()).
+    template <class Fill>
+    void submit(level lv, const call_site* site, Fill&& fill) {
+        if (rate_limited_ && !admit(lv, site)) return;
+        const detail::call_timer timer(latency_ ? &latency_->local().call : nullptr);
+
+        log_event e = make_event(lv, site);
+        fill(e);
+        dispatch(std::move(e));
+    }
+
+    // An event with the metadata the config captures and no payload yet.
+    log_event make_event(level lv, const call_site* site) const {
         log_event e;
         if (cfg_.capture_timestamp) e.ts = std::chrono::system_clock::now();
         e.lvl = lv;
         if (cfg_.capture_thread_id) e.tid = std::this_thread::get_id();
-        if (cfg_.capture_logger_name) e.name = cfg_.name;
-        try {
-            e.payload = detail::format_payload(fmt, std::forward<Args>(args)...);
-        } catch (...) {
-            e.payload = std::string(fmt.get());
+        if (cfg_.capture_logger_name) e.name = name_;
+        e.site = site;
+        return e;
+    }
+
+    void dispatch(log_event&& e) {
+        if (detail::crash_draining()) return; // a crash handler is flushing (install_crash_handler)
+        switch (pipeline_) {
+        case pipeline::single_threaded: return emit<pipeline::single_threaded>(std::move(e));
+        case pipeline::sync: return emit<pipeline::sync>(std::move(e));
+        case pipeline::async_drop: return emit<pipeline::async_drop>(std::move(e));
+        case pipeline::async_block: return emit<pipeline::async_block>(std::move(e));
         }
+    }
 
-        if (single_threaded_) {
+    template <pipeline P>
+    void emit(log_event&& e) {
+        const level lv = e.lvl;
+        if constexpr (P == pipeline::single_threaded) {
             e.seq = seq_st_++;
-            sink_batch_write_one(e);
+            sink_batch_write_one(std::move(e));
             ++enqueued_st_;
             ++dequeued_st_;
             if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
-            return;
-        }
-
-        e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
-
-        if (cfg_.async.enabled) {
-            const int w = level_weight(lv);
-            const bool ok = queue_->try_push(std::move(e), w);
-            if (ok) {
+        } else if constexpr (P == pipeline::sync) {
+            e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+            sink_batch_write_one(std::move(e));
+            if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
+        } else {
+            e.seq = seq_.fetch_add(1, std::memory_order_relaxed);
+            e.origin = ticket_.origin;
+            if (queue_->try_push(std::move(e), lv)) {
                 stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
+            } else if (P == pipeline::async_block || static_cast<int>(lv) >= static_cast<int>(level::warn)) {
+                // warn+ is never dropped, even with drop_when_full.
+                push_blocked(std::move(e), lv);
             } else {
-                if (cfg_.async.drop_when_full) {
-                    if (static_cast<int>(lv) >= static_cast<int>(level::warn)) {
-                        queue_->push_blocking(std::move(e), w);
-                        stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                    } else {
-                        stats_.dropped.fetch_add(1, std::memory_order_relaxed);
-                    }
-                } else {
-                    queue_->push_blocking(std::move(e), w);
-                    stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
-                }
+                count_drop(lv);
             }
-            return;
         }
-
-        sink_batch_write_one(e);
-        if (static_cast<int>(lv) >= static_cast<int>(cfg_.flush_on_level)) flush();
     }
 
     template <class... Args>
-    void trace(std::format_string<Args...> f, Args&&... a) { log(level::trace, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void trace(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::trace, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    void fill_payload_runtime(log_event& e, std::string_view fmt, Args&&... args) {
+        try {
+            detail::vformat_payload_into(e.payload, fmt, std::forward<Args>(args)...);
+        } catch (...) {
+            // Keep logging non-fatal even if formatting fails.
+            e.payload.assign(fmt);
+        }
     }
 
     template <class... Args>
-    void debug(std::format_string<Args...> f, Args&&... a) { log(level::debug, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void debug(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::debug, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    void fill_payload(log_event& e, std::format_string<Args...> fmt, Args&&... args) {
+        if constexpr (detail::is_deferrable_v<Args...>) {
+            if (deferred_format_) {
+                detail::encode_args(e.payload, args...);
+                e.deferred = &detail::deferred_codec_for<Args...>;
+                e.deferred_fmt = fmt.get();
+                return;
+            }
+        }
+        try {
+            detail::format_payload_to(e.payload, fmt, std::forward<Args>(args)...);
+        } catch (...) {
+            // Keep logging non-fatal even if formatting fails.
+            e.payload.assign(fmt.get());
+        }
     }
 
-    template <class... Args>
-    void info(std::format_string<Args...> f, Args&&... a) { log(level::info, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void info(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::info, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    template <class... Fields>
+    static void fill_fields(log_event& e, std::string_view msg, const Fields&... fields) {
+        detail::encode_fields(e.payload, msg, fields...);
     }
 
-    template <class... Args>
-    void warn(std::format_string<Args...> f, Args&&... a) { log(level::warn, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void warn(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::warn, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    // Worker-side: turn encoded deferred records into formatted payloads. Skipped when every
+    // sink consumes encoded arguments itself (e.g. binary_file_sink).
+    void materialize_deferred(std::span<log_event> batch, const sink_list* sinks) {
+        if (!deferred_format_) return;
+        if (sinks && !sinks->empty() &&
+            std::all_of(sinks->begin(), sinks->end(), [](const auto& s) { return s->accepts_deferred(); }))
+            return;
+        for (auto& e : batch) {
+            if (!e.deferred) continue;
+            format_buf_.clear();
+            try {
+                e.deferred->format(format_buf_, e.deferred_fmt, e.payload.data());
+            } catch (...) {
+                format_buf_.assign(e.deferred_fmt);
+            }
+            e.payload.assign(format_buf_);
+            e.deferred = nullptr;
+        }
     }
 
-    template <class... Args>
-    void error(std::format_string<Args...> f, Args&&... a) { log(level::error, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void error(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::error, std::forward<Fmt>(f), std::forward<Args>(a)...);
-    }
+    // One heap block per event shared by all per-sink tasks (instead of a log_event copy per sink).
+    struct parallel_job {
+        log_event ev;
+        std::shared_ptr<const sink_list> sinks;
+    };
 
-    template <class... Args>
-    void critical(std::format_string<Args...> f, Args&&... a) { log(level::critical, f, std::forward<Args>(a)...); }
-    template <class Fmt, class... Args>
-    void critical(Fmt&& f, Args&&... a)
-        requires(std::is_convertible_v<Fmt, std::string_view> &&
-                 !(std::is_array_v<std::remove_reference_t<Fmt>> &&
-                   std::is_same_v<std::remove_cv_t<std::remove_extent_t<std::remove_reference_t<Fmt>>>, char>)) {
-        log(level::critical, std::forward<Fmt>(f), std::forward<Args>(a)...);
+    // Histogram for writes to sink #i on the calling thread (null when not instrumenting).
+    detail::histogram_shard* sink_timer(std::size_t i) {
+        return latency_ ? latency_->local().sink(i) : nullptr;
     }
 
-    void flush() {
+    void sink_batch_write_one(log_event&& e) {
         if (single_threaded_) {
-            for (auto& s : sinks_st_) {
+            for (std::size_t i = 0; i < sinks_st_.size(); ++i) {
+                auto& s = sinks_st_[i];
                 try {
-                    s->flush();
+                    if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold()))
+                        detail::timed(sink_timer(i), [&] { s->log(e); });
                 } catch (...) {
                 }
             }
-            ++flushed_st_;
             return;
         }
 
-        auto current = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-        if (current) {
-            for (auto& s : *current) {
+        const auto snap = sinks_.read();
+        const sink_list& current = *snap->sinks;
+
+        if (cfg_.parallel_sinks && pool_) {
+            const std::size_t n = current.size();
+            if (n == 0) return;
+            auto job = std::make_shared<const parallel_job>(parallel_job{std::move(e), snap->sinks});
+            for (std::size_t i = 0; i < n; ++i) {
+                pool_->enqueue([this, job, i] {
+                    const auto& s = (*job->sinks)[i];
+                    try {
+                        if (static_cast<int>(job->ev.lvl) >= static_cast<int>(s->level_threshold()))
+                            detail::timed(sink_timer(i), [&] { s->log(job->ev); });
+                    } catch (...) {
+                    }
+                });
+            }
+        } else {
+            for (std::size_t i = 0; i < current.size(); ++i) {
+                const auto& s = current[i];
                 try {
-                    s->flush();
+                    if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold()))
+                        detail::timed(sink_timer(i), [&] { s->log(e); });
                 } catch (...) {
                 }
             }
         }
-        stats_.flushed.fetch_add(1, std::memory_order_relaxed);
     }
 
-    void shutdown() {
-        if (single_threaded_) {
-            flush();
-            return;
+    void sink_write_batch(const sink_list& sinks, std::span<const log_event> events) {
+        for (std::size_t i = 0; i < sinks.size(); ++i) {
+            try {
+                detail::timed(sink_timer(i), [&] { sinks[i]->log_batch(events); });
+            } catch (...) {
+            }
         }
+    }
 
-        bool expected = false;
-        if (!stop_requested_.compare_exchange_strong(expected, true)) return;
+    // Worker-side: batch size and event-time -> sink latency for a batch that was just written.
+    void record_batch(std::span<const log_event> events) {
+        if (!latency_) return;
+        auto& shard = latency_->local();
+        shard.batch.record(events.size());
+        const auto now = std::chrono::system_clock::now();
+        for (const auto& e : events) {
+            if (e.ts.time_since_epoch().count() == 0) continue;
+            const auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(now - e.ts).count();
+            shard.queue.record(d > 0 ? static_cast<std::uint64_t>(d) : 0);
+        }
+    }
 
-        if (worker_.joinable()) {
-            queue_->signal_stop();
-            worker_.join();
+    void sink_flush_all(const sink_list& sinks) {
+        for (auto& s : sinks) {
+            try {
+                s->flush();
+            } catch (...) {
+            }
         }
+        stats_.flushed.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        if (pool_) pool_->shutdown();
-        flush();
+    // Writes batch[first, first + n) to the sinks (or offers it to the sink workers), split after
+    // events that require a flush; with `flush_last` the sinks are flushed at the end as well.
+    // `whole`: nothing else lives in `batch`, so fan_out may take it. Runs on the async worker,
+    // or on the shared backend worker serving this logger.
+    void write_out(std::vector<log_event>& batch, std::size_t first, std::size_t n, bool whole, bool flush_last) {
+        stats_.dequeued.fetch_add(n, std::memory_order_relaxed);
+        const std::span<log_event> events(batch.data() + first, n);
+
+        // Peak throughput mode: in async logging, keep sink writes on the single worker thread
+        // (or on the sink workers). This avoids per-event task scheduling + extra copying.
+        if (fanout_) {
+            // offer() may wait on a full sink worker; do that outside the read section so that
+            // add_sink/remove_sink (which wait for readers before retiring) cannot deadlock on us.
+            std::vector<std::shared_ptr<fanout_worker>> workers;
+            {
+                const auto snap = sinks_.read();
+                materialize_deferred(events, snap->sinks.get());
+                workers = snap->workers;
+            }
+            record_batch(events); // the events move into fan_out's shared block
+            fan_out(batch, first, n, whole, workers, flush_last);
+            return;
+        }
+        const auto snap = sinks_.read();
+        const sink_list& sinks = *snap->sinks;
+        materialize_deferred(events, &sinks);
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (static_cast<int>(events[i].lvl) >= static_cast<int>(cfg_.flush_on_level)) {
+                sink_write_batch(sinks, events.subspan(start, i + 1 - start));
+                sink_flush_all(sinks);
+                start = i + 1;
+            }
+        }
+        if (start < n) sink_write_batch(sinks, events.subspan(start));
+        if (flush_last && start < n) sink_flush_all(sinks);
+        record_batch(events);
     }
 
-    metrics_snapshot stats() const {
-        metrics_snapshot snap;
-        if (single_threaded_) {
-            snap.dropped = dropped_st_;
-            snap.enqueued = enqueued_st_;
-            snap.dequeued = dequeued_st_;
-            snap.flushed = flushed_st_;
-            snap.queue_size = 0;
-            return snap;
+    // detail::async_client (shared backend).
+    void deliver(std::vector<log_event>& batch, std::size_t first, std::size_t n, bool whole) override {
+        write_out(batch, first, n, whole, false);
+        // Orders the dequeued update before the flag check; pairs with await_backend_drain().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (drain_waiting_.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lk(drain_mu_);
+            drain_cv_.notify_all();
         }
-        snap.dropped = stats_.dropped.load(std::memory_order_relaxed);
-        snap.enqueued = stats_.enqueued.load(std::memory_order_relaxed);
-        snap.dequeued = stats_.dequeued.load(std::memory_order_relaxed);
-        snap.flushed = stats_.flushed.load(std::memory_order_relaxed);
-        snap.queue_size = cfg_.async.enabled && queue_ ? queue_->size_relaxed() : 0;
-        return snap;
     }
 
-private:
-    void sink_batch_write_one(const log_event& e) {
+    // shutdown() with a shared backend: blocks until the backend has delivered everything this
+    // logger enqueued.
+    void await_backend_drain() {
+        std::unique_lock<std::mutex> lk(drain_mu_);
+        drain_waiting_.store(true, std::memory_order_seq_cst);
+        drain_cv_.wait(lk, [&] {
+            return stats_.dequeued.load(std::memory_order_seq_cst) >= stats_.enqueued.load(std::memory_order_seq_cst);
+        });
+    }
+
+    void flush_sinks() {
         if (single_threaded_) {
             for (auto& s : sinks_st_) {
                 try {
-                    if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold())) s->log(e);
+                    s->flush();
                 } catch (...) {
                 }
             }
+            ++flushed_st_;
             return;
         }
 
-        auto current = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-        if (!current) return;
-
-        if (cfg_.parallel_sinks && pool_) {
-            for (auto& s : *current) {
-                pool_->enqueue([s, ev = e] {
-                    try {
-                        if (static_cast<int>(ev.lvl) >= static_cast<int>(s->level_threshold())) s->log(ev);
-                    } catch (...) {
-                    }
-                });
-            }
-        } else {
-            for (auto& s : *current) {
+        {
+            const auto current = sinks_.read();
+            for (auto& s : *current->sinks) {
                 try {
-                    if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold())) s->log(e);
+                    s->flush();
                 } catch (...) {
                 }
             }
         }
+        stats_.flushed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void timed_flush() override {
+        if (rate_limited_) write_due_summaries();
+        if (!fanout_) flush_sinks(); // sink workers run their own timed flushes
     }
 
     void worker_loop() {
+        if (cfg_.async.worker_cpu >= 0) detail::pin_current_thread(cfg_.async.worker_cpu);
+
         std::vector<log_event> batch;
         batch.reserve(cfg_.async.batch_max);
         auto last_flush = std::chrono::steady_clock::now();
+        bool dirty = false; // sinks have been written since the last timed flush
+        std::uint32_t spins = 0;
 
         while (!stop_requested_.load(std::memory_order_relaxed)) {
-            batch.clear();
-            const std::size_t n = queue_->pop_batch(batch, cfg_.async.batch_max);
+            if (detail::crash_draining() && !crash_drained_.load(std::memory_order_relaxed)) crash_drain(batch);
+            const std::size_t n = queue_->pop_into(batch, cfg_.async.batch_max);
             if (n == 0) {
-                queue_->wait_for_data(std::chrono::milliseconds(100));
+                if (detail::idle_wait(cfg_.async, *queue_, spins, last_flush, dirty))
+                    stats_.queue_size.store(queue_->size_relaxed(), std::memory_order_relaxed);
             } else {
-                stats_.dequeued.fetch_add(n, std::memory_order_relaxed);
-
-                // Peak throughput mode: in async logging, keep sink writes on the single worker thread.
-                // This avoids per-event task scheduling + extra copying.
-                const auto sinks_snapshot = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-                if (sinks_snapshot) {
-                    for (const auto& e : batch) {
-                        for (auto& s : *sinks_snapshot) {
-                            try {
-                                if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold())) s->log(e);
-                            } catch (...) {
-                            }
-                        }
-                        if (static_cast<int>(e.lvl) >= static_cast<int>(cfg_.flush_on_level)) {
-                            for (auto& s : *sinks_snapshot) {
-                                try {
-                                    s->flush();
-                                } catch (...) {
-                                }
-                            }
-                            stats_.flushed.fetch_add(1, std::memory_order_relaxed);
-                        }
-                    }
-                }
+                spins = 0;
+                dirty = true;
+                write_out(batch, 0, n, true, false);
+                stats_.queue_size.store(queue_->size_relaxed(), std::memory_order_relaxed);
             }
 
             const auto now = std::chrono::steady_clock::now();
             if (now - last_flush >= cfg_.async.flush_every) {
-                flush();
+                if (dirty || suppressed_pending_.load(std::memory_order_relaxed)) timed_flush();
+                dirty = false;
                 last_flush = now;
             }
-            stats_.queue_size.store(queue_->size_relaxed(), std::memory_order_relaxed);
         }
 
         // Drain
-        std::vector<log_event> drain;
-        drain.reserve(cfg_.async.batch_max);
         for (;;) {
-            drain.clear();
-            const std::size_t n = queue_->pop_batch(drain, cfg_.async.batch_max);
+            const std::size_t n = queue_->pop_into(batch, cfg_.async.batch_max);
             if (n == 0) break;
+            write_out(batch, 0, n, true, true);
+        }
 
-            stats_.dequeued.fetch_add(n, std::memory_order_relaxed);
+        stats_.queue_size.store(0, std::memory_order_relaxed);
+    }
 
-            const auto sinks_snapshot = std::atomic_load_explicit(&sinks_, std::memory_order_acquire);
-            if (sinks_snapshot) {
-                for (const auto& e : drain) {
-                    for (auto& s : *sinks_snapshot) {
-                        try {
-                            if (static_cast<int>(e.lvl) >= static_cast<int>(s->level_threshold())) s->log(e);
-                        } catch (...) {
-                        }
-                    }
-                }
-                for (auto& s : *sinks_snapshot) {
-                    try {
-                        s->flush();
-                    } catch (...) {
-                    }
-                }
-                stats_.flushed.fetch_add(1, std::memory_order_relaxed);
-            }
+    // A crash handler is waiting (producers are stopped): write out what is queued until the
+    // queue is empty or the drain window closes, flush, and report back.
+    void crash_drain(std::vector<log_event>& batch) {
+        while (!detail::crash_deadline_passed()) {
+            const std::size_t n = queue_->pop_into(batch, cfg_.async.batch_max);
+            if (n == 0) break;
+            write_out(batch, 0, n, true, false);
         }
+        flush_sinks();
+        crash_drained_.store(true, std::memory_order_release);
+    }
 
-        stats_.queue_size.store(0, std::memory_order_relaxed);
+    // detail::crash_target (signal context).
+    bool crash_drained() const noexcept override {
+        if (single_threaded_) return true;
+        if (worker_.joinable() && !crash_drained_.load(std::memory_order_acquire)) return false;
+        if (ticket_.queue && !cfg_.async.shared_backend->crash_drained(ticket_.shard)) return false;
+        for (const auto& w : sinks_.peek()->workers) {
+            if (w->unwritten() != 0) return false;
+        }
+        return true;
+    }
+
+    void crash_flush_sinks() noexcept override {
+        for (const auto& s : single_threaded_ ? sinks_st_ : *sinks_.peek()->sinks) s->crash_flush();
+    }
+
+    // Without a signal-safe wake the worker notices at its next timed wakeup (flush_every).
+    void crash_wake() noexcept override {
+        if constexpr (detail::wake_signal::signal_safe) {
+            if (queue_) queue_->wake();
+        }
     }
 
     logger_config cfg_;
+    std::string_view name_; // cfg_.name, interned (see log_event::name)
     bool single_threaded_ = false;
-    using sink_list = std::vector<std::shared_ptr<sink>>;
-    std::atomic<std::shared_ptr<const sink_list>> sinks_{std::make_shared<sink_list>()};
-    mutable std::mutex sinks_mu_;
+    bool deferred_format_ = false;
+    bool rate_limited_ = false;
+    // Sites (and the level they were called at) that started suppressing since their last
+    // report; see take_summaries().
+    std::mutex suppressed_mu_;
+    std::vector<std::pair<const call_site*, level>> suppressed_sites_; // under suppressed_mu_
+    std::atomic<bool> suppressed_pending_{false};
+    pipeline pipeline_ = pipeline::sync;
+    std::string format_buf_; // worker-only scratch for deferred formatting
+    detail::rcu_cell<sink_set> sinks_{std::make_unique<const sink_set>(sink_set{std::make_shared<const sink_list>(), {}, {}})};
+    mutable std::mutex sinks_mu_; // serializes sinks_ writers
+    bool fanout_ = false;         // async.sink_workers
+    std::map<std::string, std::shared_ptr<fanout_worker>, std::less<>> named_workers_; // under sinks_mu_
+    std::vector<std::shared_ptr<fanout_worker>> retired_workers_;                      // under sinks_mu_
+    std::atomic<int> sink_floor_{static_cast<int>(level::off)};
+    std::atomic<std::uint64_t> sink_floor_gen_{0};
 
     sink_list sinks_st_;
 
     std::atomic<std::uint64_t> seq_;
     std::uint64_t seq_st_ = 0;
-    std::unique_ptr<dual_queue<log_event>> queue_;
+    std::shared_ptr<detail::event_queue> queue_; // own queue, or a shared backend shard
+    async_backend::ticket ticket_;               // shared backend registration (origin 0 otherwise)
+    std::mutex drain_mu_;                        // shutdown() waiting for the shared backend
+    std::condition_variable drain_cv_;
+    std::atomic<bool> drain_waiting_{false};
     std::thread worker_;
     std::atomic<bool> stop_requested_{false};
+    std::atomic<bool> crash_drained_{false}; // worker finished its crash drain
 
     metrics stats_;
+    std::unique_ptr<detail::latency_registry> latency_; // null unless cfg.latency_histograms
     std::unique_ptr<thread_pool> pool_;
 
     // Single-threaded counters (no atomics).
@@ -1378,11 +6868,44 @@ private:
 };
 
 // Convenience macros for capturing source_location without changing call-sites.
-#define CHLOG_TRACE(lg, fmt, ...) (lg).log_at(::chlog::level::trace, std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
-#define CHLOG_DEBUG(lg, fmt, ...) (lg).log_at(::chlog::level::debug, std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
-#define CHLOG_INFO(lg, fmt, ...)  (lg).log_at(::chlog::level::info,  std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
-#define CHLOG_WARN(lg, fmt, ...)  (lg).log_at(::chlog::level::warn,  std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
-#define CHLOG_ERROR(lg, fmt, ...) (lg).log_at(::chlog::level::error, std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
-#define CHLOG_CRIT(lg, fmt, ...)  (lg).log_at(::chlog::level::critical, std::source_location::current(), (fmt) __VA_OPT__(,) __VA_ARGS__)
+// Each expansion owns a static call_site (file/line/function/level), built on first use, so a log
+// call only passes a pointer to it; log_at records the checked format string there.
+#define CHLOG_SITE_(lv)                                                                              \
+    ([](const std::source_location& l_) -> const ::chlog::call_site* {                               \
+        static const ::chlog::call_site site_{l_, (lv)};                                             \
+        return &site_;                                                                                \
+    }(std::source_location::current()))
+
+// Levels below CHLOG_ACTIVE_LEVEL expand to nothing (arguments are not evaluated).
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_TRACE
+    #define CHLOG_TRACE(lg, fmt, ...) (lg).log_at(::chlog::level::trace, CHLOG_SITE_(::chlog::level::trace), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_TRACE(lg, fmt, ...) static_cast<void>(0)
+#endif
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_DEBUG
+    #define CHLOG_DEBUG(lg, fmt, ...) (lg).log_at(::chlog::level::debug, CHLOG_SITE_(::chlog::level::debug), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_DEBUG(lg, fmt, ...) static_cast<void>(0)
+#endif
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_INFO
+    #define CHLOG_INFO(lg, fmt, ...)  (lg).log_at(::chlog::level::info, CHLOG_SITE_(::chlog::level::info), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_INFO(lg, fmt, ...)  static_cast<void>(0)
+#endif
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_WARN
+    #define CHLOG_WARN(lg, fmt, ...)  (lg).log_at(::chlog::level::warn, CHLOG_SITE_(::chlog::level::warn), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_WARN(lg, fmt, ...)  static_cast<void>(0)
+#endif
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_ERROR
+    #define CHLOG_ERROR(lg, fmt, ...) (lg).log_at(::chlog::level::error, CHLOG_SITE_(::chlog::level::error), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_ERROR(lg, fmt, ...) static_cast<void>(0)
+#endif
+#if CHLOG_ACTIVE_LEVEL <= CHLOG_LEVEL_CRITICAL
+    #define CHLOG_CRIT(lg, fmt, ...)  (lg).log_at(::chlog::level::critical, CHLOG_SITE_(::chlog::level::critical), (fmt) __VA_OPT__(,) __VA_ARGS__)
+#else
+    #define CHLOG_CRIT(lg, fmt, ...)  static_cast<void>(0)
+#endif
 
 } // namespace chlog
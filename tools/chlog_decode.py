@@ -0,0 +1,419 @@
+#!/usr/bin/env python3
+"""Decode files written by chlog::binary_file_sink into text or JSON lines.
+
+- Input: one or more binary log files (concatenated segments are fine)
+- Output: text rendered with a chlog-style pattern (default), or NDJSON with
+  the same fields as chlog::json_sink (--json)
+
+Encoded-argument records (async.deferred_format) are formatted here with a
+Python approximation of std::format; the common replacement fields
+({}, {N}, {:spec}) match chlog's output. Structured kv() fields (format
+version 2) are appended as " key=value" in text and as JSON members.
+"""
+
+from __future__ import annotations
+
+import argparse
+import datetime as dt
+import json
+import math
+import re
+import struct
+import sys
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Dict, Iterator, List, Optional, Tuple
+
+
+MAGIC = b"CHLOGBIN"
+HEADER_SIZE = 16
+DEFAULT_PATTERN = "[{date} {time}.{ms}][{lvl}][tid={tid}][{name}] {msg}"
+LEVEL_NAMES = ["TRACE", "DEBUG", "INFO", "WARN", "ERROR", "CRITICAL", "OFF"]
+
+
+@dataclass(frozen=True)
+class Site:
+    level: int
+    line: int
+    file: str
+    func: str
+    fmt: str
+    arg_types: str
+
+
+@dataclass(frozen=True)
+class Event:
+    ts_ns: int
+    level: int
+    tid: int
+    seq: int
+    name: str
+    site: Optional[Site]
+    msg: str
+    fields: Tuple[Tuple[str, object], ...] = ()
+
+
+class Reader:
+    def __init__(self, data: bytes) -> None:
+        self.data = data
+        self.pos = 0
+        self.endian = "<"
+        self.size_t = 8
+        self.ptr = 8
+        self.long_double = 16
+        self.version = 1
+
+    def eof(self) -> bool:
+        return self.pos >= len(self.data)
+
+    def take(self, n: int) -> bytes:
+        if self.pos + n > len(self.data):
+            raise EOFError("truncated record")
+        b = self.data[self.pos : self.pos + n]
+        self.pos += n
+        return b
+
+    def unpack(self, code: str):
+        size = struct.calcsize("<" + code)
+        return struct.unpack(self.endian + code, self.take(size))[0]
+
+    def uint(self, size: int) -> int:
+        return int.from_bytes(self.take(size), "little" if self.endian == "<" else "big")
+
+    def string(self) -> str:
+        n = self.unpack("I")
+        return self.take(n).decode("utf-8", errors="replace")
+
+    def header(self) -> None:
+        if self.take(len(MAGIC)) != MAGIC:
+            raise ValueError(f"bad magic at offset {self.pos - len(MAGIC)}")
+        version, little, size_t, ptr, long_double = struct.unpack("<5B", self.take(5))
+        self.take(3)
+        if version not in (1, 2):
+            raise ValueError(f"unsupported format version {version}")
+        self.version = version
+        self.endian = "<" if little else ">"
+        self.size_t, self.ptr, self.long_double = size_t, ptr, long_double
+
+
+# ---------------------------------------------------------------------------
+# Encoded arguments (mirror of detail::encode_args / detail::arg_tag)
+
+
+class Pointer(int):
+    pass
+
+
+class Char(str):
+    pass
+
+
+def decode_long_double(r: Reader) -> float:
+    raw = r.take(r.long_double)
+    if r.long_double == 8:
+        return struct.unpack(r.endian + "d", raw)[0]
+    if r.endian != "<" or r.long_double < 10:
+        return float("nan")
+    # x87 80-bit extended precision (padded to 12/16 bytes).
+    mant = int.from_bytes(raw[:8], "little")
+    se = int.from_bytes(raw[8:10], "little")
+    sign = -1.0 if se & 0x8000 else 1.0
+    exp = se & 0x7FFF
+    if exp == 0x7FFF:
+        return sign * math.inf if (mant << 1) & ((1 << 64) - 1) == 0 else math.nan
+    if exp == 0 and mant == 0:
+        return sign * 0.0
+    try:
+        return sign * math.ldexp(mant, exp - 16383 - 63)
+    except OverflowError:
+        return sign * math.inf
+
+
+def decode_args(r: Reader, types: str) -> list:
+    out: list = []
+    for t in types:
+        if t == "s":
+            n = r.uint(r.size_t)
+            out.append(r.take(n).decode("utf-8", errors="replace"))
+        elif t == "?":
+            out.append(bool(r.unpack("B")))
+        elif t == "c":
+            out.append(Char(chr(r.unpack("B"))))
+        elif t in "bBhHiIqQ":
+            out.append(r.unpack(t))
+        elif t == "f":
+            out.append(r.unpack("f"))
+        elif t == "d":
+            out.append(r.unpack("d"))
+        elif t == "g":
+            out.append(decode_long_double(r))
+        elif t == "n":
+            r.take(r.ptr)
+            out.append(Pointer(0))
+        elif t == "P":
+            out.append(Pointer(r.uint(r.ptr)))
+        else:
+            raise ValueError(f"unknown argument tag {t!r}")
+    return out
+
+
+def decode_fields(r: Reader) -> Tuple[Tuple[str, object], ...]:
+    """Structured field records (mirror of detail::encode_field)."""
+    out: List[Tuple[str, object]] = []
+    while not r.eof():
+        t = r.take(1).decode("ascii")
+        key = r.take(r.unpack("B")).decode("utf-8", errors="replace")
+        if t == "s":
+            out.append((key, r.take(r.unpack("I")).decode("utf-8", errors="replace")))
+        elif t == "?":
+            out.append((key, bool(r.unpack("B"))))
+        elif t in "qQd":
+            out.append((key, r.unpack(t)))
+        else:
+            raise ValueError(f"unknown field type {t!r}")
+    return tuple(out)
+
+
+# ---------------------------------------------------------------------------
+# std::format approximation
+
+
+def shortest_float(x: float, single: bool) -> str:
+    """std::format("{}", x): shortest round-trip digits, fixed or scientific (whichever is shorter)."""
+    if math.isnan(x):
+        return "-nan" if math.copysign(1.0, x) < 0 else "nan"
+    if math.isinf(x):
+        return "-inf" if x < 0 else "inf"
+    if x == 0.0:
+        return "-0" if math.copysign(1.0, x) < 0 else "0"
+    sci = ""
+    for p in range(0, 17):
+        sci = f"{x:.{p}e}"
+        back = float(sci)
+        if (struct.pack("<f", back) == struct.pack("<f", x)) if single else back == x:
+            break
+    mant, exp_s = sci.split("e")
+    exp = int(exp_s)
+    sign = "-" if mant.startswith("-") else ""
+    digits = mant.lstrip("-").replace(".", "").rstrip("0") or "0"
+    sci_str = sign + digits[0] + ("." + digits[1:] if len(digits) > 1 else "") + f"e{'-' if exp < 0 else '+'}{abs(exp):02d}"
+    point = exp + 1
+    if point <= 0:
+        fixed = "0." + "0" * (-point) + digits
+    elif point >= len(digits):
+        fixed = digits + "0" * (point - len(digits))
+    else:
+        fixed = digits[:point] + "." + digits[point:]
+    fixed = sign + fixed
+    return fixed if len(fixed) <= len(sci_str) else sci_str
+
+
+def format_value(v, spec: str, tag: str) -> str:
+    kind = spec[-1:] if spec[-1:].isalpha() or spec[-1:] == "?" else ""
+    if isinstance(v, bool):
+        if kind in ("", "s"):
+            return format("true" if v else "false", spec.rstrip("s"))
+        return format(int(v), spec)
+    if isinstance(v, Pointer):
+        if kind in ("", "p"):
+            return format(hex(int(v)), spec[:-1] if kind else spec)
+        return format(int(v), spec)
+    if isinstance(v, Char):
+        if kind in ("", "c"):
+            return format(str(v), spec[:-1] if kind else spec)
+        return format(ord(v), spec)
+    if isinstance(v, int):
+        if kind == "c":
+            return format(chr(v), spec[:-1])
+        return format(v, spec)
+    if isinstance(v, float):
+        if kind == "":
+            base = shortest_float(v, tag == "f")
+            return format(base, spec) if spec else base
+        if kind == "a":
+            return format(v.hex(), spec[:-1])
+        return format(v, spec)
+    return format(v, spec.rstrip("s?"))
+
+
+def vformat(fmt: str, args: list, types: str) -> str:
+    out: List[str] = []
+    auto = 0
+    i = 0
+    n = len(fmt)
+
+    def arg_at(index_s: str) -> int:
+        nonlocal auto
+        if index_s == "":
+            auto += 1
+            return auto - 1
+        return int(index_s)
+
+    while i < n:
+        c = fmt[i]
+        if c == "{":
+            if i + 1 < n and fmt[i + 1] == "{":
+                out.append("{")
+                i += 2
+                continue
+            depth, j = 1, i + 1
+            while j < n and depth:
+                depth += {"{": 1, "}": -1}.get(fmt[j], 0)
+                j += 1
+            field = fmt[i + 1 : j - 1]
+            arg_s, _, spec = field.partition(":")
+            idx = arg_at(arg_s.strip())
+            # Nested dynamic width / precision, e.g. {:{}.{}f}
+            spec = re.sub(r"\{(\d*)\}", lambda m: str(args[arg_at(m.group(1))]), spec)
+            out.append(format_value(args[idx], spec, types[idx] if idx < len(types) else ""))
+            i = j
+        elif c == "}":
+            out.append("}")
+            i += 2 if i + 1 < n and fmt[i + 1] == "}" else 1
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+# ---------------------------------------------------------------------------
+# Records
+
+
+def read_events(data: bytes) -> Iterator[Event]:
+    r = Reader(data)
+    sites: Dict[int, Site] = {}
+    names: Dict[int, str] = {}
+    while not r.eof():
+        if data.startswith(MAGIC, r.pos):
+            r.header()
+            sites.clear()
+            names.clear()
+            continue
+        tag = r.take(1)
+        if tag == b"S":
+            sid = r.unpack("I")
+            level = r.unpack("B")
+            line = r.unpack("I")
+            sites[sid] = Site(level, line, r.string(), r.string(), r.string(), r.string())
+        elif tag == b"N":
+            nid = r.unpack("I")
+            names[nid] = r.string()
+        elif tag == b"E":
+            sid = r.unpack("I")
+            nid = r.unpack("I")
+            ts_ns = r.unpack("q")
+            level = r.unpack("B")
+            tid = r.unpack("Q")
+            seq = r.unpack("Q")
+            kind = r.unpack("B")
+            n = r.unpack("I")
+            payload = r.take(n)
+            fields: Tuple[Tuple[str, object], ...] = ()
+            if r.version >= 2:
+                sub = Reader(r.take(r.unpack("I")))
+                sub.endian = r.endian
+                fields = decode_fields(sub)
+            site = sites.get(sid)
+            if kind == 1 and site is not None:
+                sub = Reader(payload)
+                sub.endian, sub.size_t, sub.ptr, sub.long_double = r.endian, r.size_t, r.ptr, r.long_double
+                try:
+                    msg = vformat(site.fmt, decode_args(sub, site.arg_types), site.arg_types)
+                except (ValueError, IndexError, EOFError, OverflowError):
+                    msg = site.fmt
+            else:
+                msg = payload.decode("utf-8", errors="replace")
+            yield Event(ts_ns, level, tid, seq, names.get(nid, ""), site, msg, fields)
+        else:
+            raise ValueError(f"unknown record tag {tag!r} at offset {r.pos - 1}")
+
+
+def level_name(lv: int) -> str:
+    return LEVEL_NAMES[lv] if 0 <= lv < len(LEVEL_NAMES) else str(lv)
+
+
+def field_text(v: object) -> str:
+    """chlog's " key=value" rendering (detail::append_fields_text)."""
+    if isinstance(v, bool):
+        return "true" if v else "false"
+    if isinstance(v, float):
+        return shortest_float(v, False)
+    if isinstance(v, int):
+        return str(v)
+    s = str(v)
+    if not s or any(c <= " " or c in '"=' for c in s):
+        return json.dumps(s, ensure_ascii=False)
+    return s
+
+
+def render_text(e: Event, pattern: str) -> str:
+    t = dt.datetime.fromtimestamp(e.ts_ns // 1_000_000_000)
+    sub_ns = e.ts_ns % 1_000_000_000
+    date, time = t.strftime("%Y-%m-%d"), t.strftime("%H:%M:%S")
+    fields = {
+        "ts": f"{date} {time}.{sub_ns // 1_000_000:03d}",
+        "date": date,
+        "time": time,
+        "ms": f"{sub_ns // 1_000_000:03d}",
+        "us": f"{sub_ns // 1_000:06d}",
+        "ns": f"{sub_ns:09d}",
+        "lvl": level_name(e.level),
+        "tid": str(e.tid),
+        "name": e.name,
+        "msg": e.msg + "".join(f" {k}={field_text(v)}" for k, v in e.fields),
+        "file": e.site.file if e.site else "",
+        "line": str(e.site.line if e.site else 0),
+        "func": e.site.func if e.site else "",
+    }
+    return re.sub(r"\{(\w+)\}", lambda m: fields.get(m.group(1), m.group(0)), pattern)
+
+
+def render_json(e: Event) -> str:
+    t = dt.datetime.fromtimestamp(e.ts_ns // 1_000_000_000)
+    ts = t.strftime("%Y-%m-%d %H:%M:%S") + f".{e.ts_ns % 1_000_000_000 // 1_000_000:03d}"
+    obj = {
+        "ts": ts,
+        "lvl": level_name(e.level),
+        "tid": str(e.tid),
+        "name": e.name,
+        "seq": e.seq,
+        "file": e.site.file if e.site else "",
+        "line": e.site.line if e.site else 0,
+        "func": e.site.func if e.site else "",
+        "msg": e.msg,
+    }
+    for k, v in e.fields:
+        obj[k] = None if isinstance(v, float) and not math.isfinite(v) else v
+    return json.dumps(obj, ensure_ascii=False, separators=(",", ":"))
+
+
+def decode_file(path: Path, out, as_json: bool, pattern: str) -> None:
+    for e in read_events(path.read_bytes()):
+        out.write((render_json(e) if as_json else render_text(e, pattern)) + "\n")
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    ap = argparse.ArgumentParser(description="Decode chlog binary_file_sink logs")
+    ap.add_argument("files", nargs="+", type=Path, help="binary log files")
+    ap.add_argument("--json", action="store_true", help="emit NDJSON (json_sink fields)")
+    ap.add_argument("--pattern", default=DEFAULT_PATTERN, help=f"text pattern (default: {DEFAULT_PATTERN!r})")
+    ap.add_argument("-o", "--output", type=Path, default=None, help="write to file instead of stdout")
+    args = ap.parse_args(argv)
+
+    out = args.output.open("w", encoding="utf-8") if args.output else sys.stdout
+    try:
+        for f in args.files:
+            try:
+                decode_file(f, out, args.json, args.pattern)
+            except (ValueError, EOFError) as ex:
+                print(f"{f}: {ex}", file=sys.stderr)
+                return 1
+    finally:
+        if args.output:
+            out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
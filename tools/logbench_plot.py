@@ -6,6 +6,9 @@
 
 The chart uses log10(calls/s) scaling so very fast cases (e.g. filtered_out)
 can still be shown alongside slower cases.
+
+--chart latency / queue plot the p50/p99/p999 columns of the "Scenarios"
+tables instead (call latency and enqueue-to-sink latency, log10(ns)).
 """
 
 from __future__ import annotations
@@ -21,7 +24,7 @@ from typing import Dict, List, Optional, Tuple
 class SummaryTable:
     runners: List[str]
     cases: List[str]
-    cps: Dict[Tuple[str, str], float]  # (case, runner) -> calls/s
+    cps: Dict[Tuple[str, str], float]  # (case, runner) -> calls/s (or ns for latency charts)
 
 
 def _parse_float_cell(cell: str) -> Optional[float]:
@@ -35,6 +38,23 @@ def _parse_float_cell(cell: str) -> Optional[float]:
         return None
 
 
+def _split_row(line: str) -> List[str]:
+    return [c.strip() for c in line.strip().strip("|").split("|")]
+
+
+def _table_rows(lines: List[str], header_i: int) -> List[List[str]]:
+    # Data rows start after separator row and end at the first non-table line
+    rows: List[List[str]] = []
+    row_i = header_i + 2
+    while row_i < len(lines):
+        row = lines[row_i].strip()
+        if not row or not row.startswith("|"):
+            break
+        rows.append(_split_row(row))
+        row_i += 1
+    return rows
+
+
 def parse_summary_table(md_text: str) -> SummaryTable:
     lines = md_text.splitlines()
 
@@ -56,7 +76,7 @@ def parse_summary_table(md_text: str) -> SummaryTable:
     if header_i is None:
         raise SystemExit("Could not find summary table header row")
 
-    header_cells = [c.strip() for c in lines[header_i].strip().strip("|").split("|")]
+    header_cells = _split_row(lines[header_i])
     if len(header_cells) < 2 or header_cells[0] != "Case":
         raise SystemExit("Unexpected summary table header format")
 
@@ -65,15 +85,7 @@ def parse_summary_table(md_text: str) -> SummaryTable:
     cps: Dict[Tuple[str, str], float] = {}
     cases: List[str] = []
 
-    # Data rows start after separator row
-    row_i = header_i + 2
-    while row_i < len(lines):
-        row = lines[row_i].strip()
-        if not row:
-            break
-        if not row.startswith("|"):
-            break
-        cells = [c.strip() for c in row.strip().strip("|").split("|")]
+    for cells in _table_rows(lines, header_i):
         if len(cells) != 1 + len(runners):
             break
         case = cells[0]
@@ -82,7 +94,6 @@ def parse_summary_table(md_text: str) -> SummaryTable:
             v = _parse_float_cell(cells[1 + j])
             if v is not None:
                 cps[(case, runner)] = v
-        row_i += 1
 
     if not cases:
         raise SystemExit("Summary table has no data rows")
@@ -90,6 +101,47 @@ def parse_summary_table(md_text: str) -> SummaryTable:
     return SummaryTable(runners=runners, cases=cases, cps=cps)
 
 
+def parse_scenario_tables(md_text: str, columns: List[str]) -> SummaryTable:
+    """Collect `columns` (e.g. "call p99") of every table under '## Scenarios'."""
+    lines = md_text.splitlines()
+
+    start = None
+    for i, line in enumerate(lines):
+        if line.strip().startswith("## Scenarios"):
+            start = i
+            break
+    if start is None:
+        raise SystemExit("Could not find '## Scenarios' section in markdown")
+
+    cps: Dict[Tuple[str, str], float] = {}
+    cases: List[str] = []
+
+    for i in range(start + 1, len(lines)):
+        line = lines[i].strip()
+        if line.startswith("## "):
+            break
+        if not line.startswith("| Case "):
+            continue
+        header = _split_row(line)
+        missing = [c for c in columns if c not in header]
+        if missing:
+            raise SystemExit(f"Scenario table lacks column(s): {', '.join(missing)}")
+        for cells in _table_rows(lines, i):
+            if len(cells) != len(header):
+                break
+            case = cells[0]
+            cases.append(case)
+            for col in columns:
+                v = _parse_float_cell(cells[header.index(col)])
+                if v is not None:
+                    cps[(case, col)] = v
+
+    if not cases:
+        raise SystemExit("Scenario tables have no data rows")
+
+    return SummaryTable(runners=list(columns), cases=cases, cps=cps)
+
+
 def _fmt_sci(v: float) -> str:
     # Match the report's style like 5.026e+06
     return f"{v:.3e}"
@@ -100,6 +152,8 @@ def render_svg_bar_chart(
     title: str,
     width: int = 980,
     height: int = 480,
+    y_label: str = "calls/s (log10 scale)",
+    legend_title: str = "Runners",
 ) -> str:
     # Layout
     margin_l = 90
@@ -113,7 +167,7 @@ def render_svg_bar_chart(
     # Determine log10 scale range
     values = [v for v in table.cps.values() if v > 0]
     if not values:
-        raise SystemExit("No positive calls/s values found")
+        raise SystemExit("No positive values found")
 
     log_vals = [math.log10(v) for v in values]
     y_min = math.floor(min(log_vals))
@@ -168,7 +222,7 @@ def render_svg_bar_chart(
     # Y axis label
     out.append(
         f'<text x="{25}" y="{margin_t + plot_h/2:.2f}" transform="rotate(-90 25,{margin_t + plot_h/2:.2f})" '
-        f'font-family="Segoe UI, Arial" font-size="12" fill="#333">calls/s (log10 scale)</text>'
+        f'font-family="Segoe UI, Arial" font-size="12" fill="#333">{_xml_escape(y_label)}</text>'
     )
 
     # Bars
@@ -204,7 +258,7 @@ def render_svg_bar_chart(
     leg_x = axis_x1 - 220
     leg_y = margin_t - 42
     out.append(f'<rect x="{leg_x}" y="{leg_y}" width="210" height="{18 + 18*n_runners}" fill="#fff" stroke="#ddd" />')
-    out.append(f'<text x="{leg_x + 10}" y="{leg_y + 18}" font-family="Segoe UI, Arial" font-size="12" fill="#111">Runners</text>')
+    out.append(f'<text x="{leg_x + 10}" y="{leg_y + 18}" font-family="Segoe UI, Arial" font-size="12" fill="#111">{_xml_escape(legend_title)}</text>')
     for ri, runner in enumerate(table.runners):
         y = leg_y + 18 + (ri + 1) * 18
         color = palette[ri % len(palette)]
@@ -231,16 +285,33 @@ def main() -> int:
     ap = argparse.ArgumentParser(description="Generate an SVG bar chart from docs/logbench_results.md")
     ap.add_argument("--in", dest="in_path", default="docs/logbench_results.md", help="Input markdown path")
     ap.add_argument("--out", dest="out_path", default="docs/logbench_summary.svg", help="Output SVG path")
-    ap.add_argument("--title", dest="title", default="chlog vs spdlog (calls/s, log scale)", help="Chart title")
+    ap.add_argument("--title", dest="title", default=None, help="Chart title")
+    ap.add_argument(
+        "--chart",
+        choices=["summary", "latency", "queue"],
+        default="summary",
+        help="summary: calls/s per runner; latency / queue: scenario call / enqueue-to-sink percentiles",
+    )
     args = ap.parse_args()
 
     in_path = Path(args.in_path)
     out_path = Path(args.out_path)
 
     md = in_path.read_text(encoding="utf-8")
-    table = parse_summary_table(md)
-
-    svg = render_svg_bar_chart(table=table, title=args.title)
+    if args.chart == "summary":
+        table = parse_summary_table(md)
+        title = args.title or "chlog vs spdlog (calls/s, log scale)"
+        svg = render_svg_bar_chart(table=table, title=title)
+    else:
+        prefix = "call" if args.chart == "latency" else "queue"
+        table = parse_scenario_tables(md, [f"{prefix} p50", f"{prefix} p99", f"{prefix} p999"])
+        what = "call latency" if args.chart == "latency" else "enqueue-to-sink latency"
+        title = args.title or f"chlog scenarios: {what} (ns, log scale)"
+        # One group per scenario; widen so the case labels stay readable.
+        width = max(980, 90 * len(table.cases) + 120)
+        svg = render_svg_bar_chart(
+            table=table, title=title, width=width, y_label="ns (log10 scale)", legend_title="Percentiles"
+        )
 
     out_path.parent.mkdir(parents=True, exist_ok=True)
     out_path.write_text(svg, encoding="utf-8")
@@ -25,6 +25,17 @@ class Result:
     processed: int
     dropped: int
     cps: float
+    # Scenario cases only (real sinks, see loggers_bench.cpp); group is empty otherwise.
+    group: str = ""
+    threads: int = 1
+    payload: int = 0
+    mibps: float = 0.0
+    call_p50_ns: int = 0
+    call_p99_ns: int = 0
+    call_p999_ns: int = 0
+    queue_p50_ns: int = 0
+    queue_p99_ns: int = 0
+    queue_p999_ns: int = 0
 
 
 def parse_kv(s: str) -> Dict[str, str]:
@@ -77,6 +88,16 @@ def run_exe(exe: Path, env: Dict[str, str]) -> List[Result]:
                 processed=int(kv.get("processed", "0")),
                 dropped=int(kv.get("dropped", "0")),
                 cps=float(kv["cps"]),
+                group=kv.get("group", ""),
+                threads=int(kv.get("threads", "1")),
+                payload=int(kv.get("payload", "0")),
+                mibps=float(kv.get("mibps", "0")),
+                call_p50_ns=int(kv.get("call_p50_ns", "0")),
+                call_p99_ns=int(kv.get("call_p99_ns", "0")),
+                call_p999_ns=int(kv.get("call_p999_ns", "0")),
+                queue_p50_ns=int(kv.get("queue_p50_ns", "0")),
+                queue_p99_ns=int(kv.get("queue_p99_ns", "0")),
+                queue_p999_ns=int(kv.get("queue_p999_ns", "0")),
             )
         )
 
@@ -96,6 +117,10 @@ def fmt_num(x: Optional[float]) -> str:
     return f"{x:.3f}"
 
 
+def fmt_ns(ns: int) -> str:
+    return str(ns) if ns > 0 else "-"
+
+
 def windows_cpu_name() -> Optional[str]:
     try:
         import winreg
@@ -196,6 +221,8 @@ def main() -> int:
     ap.add_argument("--build-dir", default="build-clang", help="CMake build directory containing executables")
     ap.add_argument("--out", default="docs/logbench_results.md", help="Markdown output path")
     ap.add_argument("--iters", type=int, default=1_000_000, help="Iterations (CHLOG_BENCH_ITERS)")
+    ap.add_argument("--sink-iters", type=int, default=0, help="Calls per real-sink scenario (CHLOG_BENCH_SINK_ITERS)")
+    ap.add_argument("--threads", type=int, default=0, help="Largest producer count in the thread sweep (CHLOG_BENCH_THREADS)")
     args = ap.parse_args()
 
     root = Path(__file__).resolve().parent.parent
@@ -207,13 +234,21 @@ def main() -> int:
 
     env = dict(os.environ)
     env["CHLOG_BENCH_ITERS"] = str(args.iters)
+    if args.sink_iters > 0:
+        env["CHLOG_BENCH_SINK_ITERS"] = str(args.sink_iters)
+    if args.threads > 0:
+        env["CHLOG_BENCH_THREADS"] = str(args.threads)
 
     results = run_exe(exe, env)
 
-    # index by case -> runner
+    # index by case -> runner (comparison cases); scenarios by group, in run order
     by_case: Dict[str, Dict[str, Result]] = {}
+    by_group: Dict[str, List[Result]] = {}
     for r in results:
-        by_case.setdefault(r.case, {})[r.runner] = r
+        if r.group:
+            by_group.setdefault(r.group, []).append(r)
+        else:
+            by_case.setdefault(r.case, {})[r.runner] = r
 
     out_path = (root / args.out).resolve()
     out_path.parent.mkdir(parents=True, exist_ok=True)
@@ -228,7 +263,7 @@ def main() -> int:
     versions = vcpkg_versions(["spdlog", "fmt"])
     chlog_ver = read_chlog_version(root)
 
-    runners = sorted({r.runner for r in results})
+    runners = sorted({r.runner for r in results if not r.group})
 
     with out_path.open("w", encoding="utf-8", newline="\n") as f:
         f.write("# chlog vs spdlog benchmark report\n\n")
@@ -278,6 +313,28 @@ def main() -> int:
                 )
             f.write("\n")
 
+        if by_group:
+            f.write("## Scenarios (real sinks)\n\n")
+            f.write(
+                "File and JSON sinks writing to tmpfs, with latency histograms on. "
+                "Latencies are in ns: *call* is the time inside one log call, "
+                "*queue* is enqueue-to-sink (async only).\n\n"
+            )
+            for group, rows in by_group.items():
+                f.write(f"### {group}\n\n")
+                f.write(
+                    "| Case | threads | payload | calls | calls/s | MiB/s | dropped "
+                    "| call p50 | call p99 | call p999 | queue p50 | queue p99 | queue p999 |\n"
+                )
+                f.write("|---|" + "|".join(["---:"] * 12) + "|\n")
+                for r in rows:
+                    f.write(
+                        f"| {r.case} | {r.threads} | {r.payload} | {r.calls} | {fmt_num(r.cps)} | {r.mibps:.1f} | {r.dropped} "
+                        f"| {fmt_ns(r.call_p50_ns)} | {fmt_ns(r.call_p99_ns)} | {fmt_ns(r.call_p999_ns)} "
+                        f"| {fmt_ns(r.queue_p50_ns)} | {fmt_ns(r.queue_p99_ns)} | {fmt_ns(r.queue_p999_ns)} |\n"
+                    )
+                f.write("\n")
+
     print(f"Wrote: {out_path}")
     return 0
 